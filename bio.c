@@ -116,6 +116,21 @@ bwrite(struct buf *b)
   iderw(b);
 }
 
+// Write the n locked buffers in bs to disk together,
+// so the driver can have them all in flight at once.
+void
+bwritev(struct buf **bs, int n)
+{
+  int i;
+
+  for(i = 0; i < n; i++){
+    if(!holdingsleep(&bs[i]->lock))
+      panic("bwritev");
+    bs[i]->flags |= B_DIRTY;
+  }
+  iderwv(bs, n);
+}
+
 // Release a locked buffer.
 // Move to the head of the MRU list.
 void
@@ -0,0 +1,86 @@
+// Console write benchmark.  Measures write throughput to the
+// console, and how much CPU a writer takes per byte, by
+// counting how far a soaker process gets while the writes are
+// in progress compared with an idle interval.  Run with one
+// CPU (make CPUS=1) so that the soaker competes with the writer.
+//
+// usage: consbench [bytes]
+
+#include "types.h"
+#include "stat.h"
+#include "user.h"
+
+#define CHUNK 512
+
+// Soaker's counter lives in shared memory so the parent can read it.
+volatile uint *spins;
+
+void
+soak(void)
+{
+  for(;;)
+    (*spins)++;
+}
+
+int
+main(int argc, char *argv[])
+{
+  char buf[CHUNK];
+  int i, n, total, pid, t0, t, idle;
+  uint s0, idlerate, busyrate, busy, x;
+
+  total = 64*1024;
+  if(argc > 1)
+    total = atoi(argv[1]);
+  if(total <= 0){
+    printf(2, "usage: consbench [bytes]\n");
+    exit();
+  }
+
+  spins = (uint*)shmbrk(4096);
+  if(spins == (uint*)-1){
+    printf(2, "consbench: shmbrk failed\n");
+    exit();
+  }
+  *spins = 0;
+  for(i = 0; i < CHUNK; i++)
+    buf[i] = (i % 64) == 63 ? '\n' : 'a' + i % 26;
+
+  pid = fork();
+  if(pid < 0){
+    printf(2, "consbench: fork failed\n");
+    exit();
+  }
+  if(pid == 0)
+    soak();
+
+  // How fast does the soaker count with the CPU to itself?
+  idle = 100;
+  s0 = *spins;
+  sleep(idle);
+  idlerate = (*spins - s0) / idle;
+
+  s0 = *spins;
+  t0 = uptime();
+  for(n = 0; n < total; n += CHUNK)
+    write(1, buf, total - n < CHUNK ? total - n : CHUNK);
+  t = uptime() - t0;
+  busyrate = t > 0 ? (*spins - s0) / t : 0;
+
+  kill(pid);
+  wait();
+
+  if(t == 0 || idlerate == 0){
+    printf(2, "\nconsbench: too fast to measure; use more bytes\n");
+    exit();
+  }
+  // busy: per mille of the CPU the writer used.
+  busy = busyrate >= idlerate ? 0 : 1000 - busyrate * 1000 / idlerate;
+  // One tick is 10ms, so the writer's ns/byte is
+  // x * 10000 / total; split to avoid overflow.
+  x = busy * t;
+  printf(2, "\n%d bytes in %d ticks: %d bytes/s, writer used %d/1000 cpu, %d ns/byte\n",
+         total, t, total * 100 / t, busy,
+         x / total * 10000 + (x % total) * 10000 / total);
+  exit();
+}
@@ -276,9 +276,17 @@ consolewrite(struct inode *ip, char *buf, int n)
 
   iunlock(ip);
   acquire(&cons.lock);
+  if(panicked){
+    cli();
+    for(;;)
+      ;
+  }
   for(i = 0; i < n; i++)
-    consputc(buf[i] & 0xff);
+    cgaputc(buf[i] & 0xff);
   release(&cons.lock);
+  // The serial port is slow, so queue the bytes and let
+  // the transmit interrupt send them.
+  n = uartwrite(buf, n);
   ilock(ip);
 
   return n;
@@ -0,0 +1,87 @@
+// Per-CPU record rings.
+//
+// Each CPU fills its own ring, with interrupts off, and readers
+// of a device (serialized by the device's lock) drain them.  The
+// CPU is the only writer of head and the readers the only writers
+// of tail, so a ring needs no lock of its own: the writer fills a
+// slot before advancing head, and the reader copies one out
+// before advancing tail.  A full ring takes no more records.
+
+#include "types.h"
+#include "defs.h"
+#include "cpuring.h"
+
+void
+cpuringinit(struct cpuring *r, void *buf, uint size, uint nslot)
+{
+  r->buf = buf;
+  r->size = size;
+  r->nslot = nslot;
+  r->head = r->tail = 0;
+}
+
+// Records in r.
+uint
+cpuringlen(struct cpuring *r)
+{
+  return r->head - r->tail;
+}
+
+// The slot for the next record, or 0 if r is full.
+// Called by r's CPU with interrupts off; cpuringpush()
+// then adds the record.
+void*
+cpuringslot(struct cpuring *r)
+{
+  if(r->head - r->tail >= r->nslot)
+    return 0;
+  return r->buf + (r->head % r->nslot) * r->size;
+}
+
+void
+cpuringpush(struct cpuring *r)
+{
+  __sync_synchronize();
+  r->head++;
+}
+
+// Discard r's records.  Called by a reader.
+void
+cpuringclear(struct cpuring *r)
+{
+  r->tail = r->head;
+}
+
+// Does one of the n rings at r hold at least min records?
+int
+cpuringready(struct cpuring *r, int n, uint min)
+{
+  int i;
+
+  for(i = 0; i < n; i++)
+    if(cpuringlen(&r[i]) >= min)
+      return 1;
+  return 0;
+}
+
+// Copy out of the n rings at r as many whole records as fit
+// in len bytes at dst, one ring after another.  Returns the
+// number of bytes copied.  Called by a reader.
+int
+cpuringread(struct cpuring *r, int n, char *dst, int len)
+{
+  int i, m;
+
+  m = 0;
+  for(i = 0; i < n; i++){
+    while(r[i].tail != r[i].head && len - m >= r[i].size){
+      __sync_synchronize();
+      memmove(dst + m, r[i].buf + (r[i].tail % r[i].nslot) * r[i].size,
+              r[i].size);
+      __sync_synchronize();
+      r[i].tail++;
+      m += r[i].size;
+    }
+  }
+  return m;
+}
@@ -0,0 +1,11 @@
+// A ring of fixed-size records filled by one CPU and drained
+// by readers of a device, as used by the profiler and tracer.
+// See cpuring.c.
+
+struct cpuring {
+  char *buf;    // nslot records of size bytes
+  uint size;
+  uint nslot;
+  uint head;    // written only by the ring's CPU
+  uint tail;    // written only by readers
+};
@@ -1,20 +1,30 @@
 struct buf;
 struct context;
+struct cpuring;
 struct file;
+struct pcidev;
+struct iovec;
 struct inode;
+struct kmem_cache;
 struct pipe;
+struct sem;
 struct proc;
 struct rtcdate;
 struct spinlock;
+struct lockstat;
+struct sysstat;
 struct sleeplock;
 struct stat;
 struct superblock;
+struct trapframe;
+struct vmspace;
 
 // bio.c
 void            binit(void);
 struct buf*     bread(uint, uint);
 void            brelse(struct buf*);
 void            bwrite(struct buf*);
+void            bwritev(struct buf**, int);
 
 // console.c
 void            consoleinit(void);
@@ -22,17 +32,36 @@ void            cprintf(char*, ...);
 void            consoleintr(int(*)(void));
 void            panic(char*) __attribute__((noreturn));
 
+// cpuring.c
+void            cpuringinit(struct cpuring*, void*, uint, uint);
+void            cpuringclear(struct cpuring*);
+uint            cpuringlen(struct cpuring*);
+void            cpuringpush(struct cpuring*);
+int             cpuringread(struct cpuring*, int, char*, int);
+int             cpuringready(struct cpuring*, int, uint);
+void*           cpuringslot(struct cpuring*);
+
 // exec.c
 int             exec(char*, char**);
 
+// fd.c
+int             fdalloc(struct file*);
+void            fdcloseall(struct proc*);
+int             fdcopy(struct proc*, struct proc*);
+void            fdfree(int);
+void            fdinit(void);
+struct file*    fd2file(int);
+
 // file.c
 struct file*    filealloc(void);
 void            fileclose(struct file*);
 struct file*    filedup(struct file*);
 void            fileinit(void);
 int             fileread(struct file*, char*, int n);
+int             filereadv(struct file*, struct iovec*, int, int);
 int             filestat(struct file*, struct stat*);
 int             filewrite(struct file*, char*, int n);
+int             filewritev(struct file*, struct iovec*, int, int);
 
 // fs.c
 void            readsb(int dev, struct superblock *sb);
@@ -42,9 +71,12 @@ struct inode*   ialloc(uint, short);
 struct inode*   idup(struct inode*);
 void            iinit(int dev);
 void            ilock(struct inode*);
+void            ilockshared(struct inode*);
 void            iput(struct inode*);
 void            iunlock(struct inode*);
 void            iunlockput(struct inode*);
+void            iunlockputshared(struct inode*);
+void            iunlockshared(struct inode*);
 void            iupdate(struct inode*);
 int             namecmp(const char*, const char*);
 struct inode*   namei(char*);
@@ -57,6 +89,7 @@ int             writei(struct inode*, char*, uint, uint);
 void            ideinit(void);
 void            ideintr(void);
 void            iderw(struct buf*);
+void            iderwv(struct buf**, int);
 
 // ioapic.c
 void            ioapicenable(int irq, int cpu);
@@ -65,9 +98,12 @@ void            ioapicinit(void);
 
 // kalloc.c
 char*           kalloc(void);
+char*           kalloc_zeroed(void);
 void            kfree(char*);
 void            kinit1(void*, void*);
 void            kinit2(void*, void*);
+void            kref(char*);
+int             kzero(void);
 
 // kbd.c
 void            kbdintr(void);
@@ -79,6 +115,7 @@ extern volatile uint*    lapic;
 void            lapiceoi(void);
 void            lapicinit(void);
 void            lapicstartap(uchar, uint);
+void            lapictimer(int);
 void            microdelay(int);
 
 // log.c
@@ -86,11 +123,17 @@ void            initlog(int dev);
 void            log_write(struct buf*);
 void            begin_op();
 void            end_op();
+void            log_sync(void);
 
 // mp.c
 extern int      ismp;
 void            mpinit(void);
 
+// pci.c
+int             pcifind(struct pcidev*, int, int, int, int);
+uint            pciread(struct pcidev*, uint);
+void            pciwrite(struct pcidev*, uint, uint);
+
 // picirq.c
 void            picenable(int);
 void            picinit(void);
@@ -98,40 +141,78 @@ void            picinit(void);
 // pipe.c
 int             pipealloc(struct file**, struct file**);
 void            pipeclose(struct pipe*, int);
+void            pipeinit(void);
 int             piperead(struct pipe*, char*, int);
 int             pipewrite(struct pipe*, char*, int);
 
 //PAGEBREAK: 16
+// profile.c
+void            profinit(void);
+int             profintr(struct trapframe*);
+
+// trace.c
+extern uint     tracemask;
+void            trace(int, uint, uint);
+void            traceinit(void);
+
 // proc.c
+int             clone(void(*)(void*), void*, void*);
 void            exit(void);
 int             fork(void);
+int             futexwait(int*, int);
+int             futexwake(int*, int);
 int             growproc(int);
+int             join(void**);
 int             kill(int);
+int             kthreadcreate(void(*)(void), char*);
 void            pinit(void);
 void            procdump(void);
 void            scheduler(void) __attribute__((noreturn));
 void            sched(void);
 void            sleep(void*, struct spinlock*);
+void            switchvm(pde_t*, struct vmspace*);
+void            threadsync(void);
 void            userinit(void);
+struct vmspace* vmspacealloc(void);
+void            vmspacefree(struct vmspace*);
+void            vmlock(void);
+void            vmunlock(void);
+int             vmshared(void);
 int             wait(void);
 void            wakeup(void*);
+int             wakeupn(void*, int);
 void            yield(void);
 
 // swtch.S
 void            swtch(struct context**, struct context*);
 
+// sem.c
+int             semalloc(struct file**, int, int);
+void            semclose(struct sem*);
+void            seminit(void);
+int             semread(struct sem*, char*, int);
+int             semwrite(struct sem*, char*, int);
+
+// slab.c
+void*           kmem_cache_alloc(struct kmem_cache*);
+struct kmem_cache* kmem_cache_create(char*, uint);
+void            kmem_cache_free(struct kmem_cache*, void*);
+
 // spinlock.c
 void            acquire(struct spinlock*);
 void            getcallerpcs(void*, uint*);
 int             holding(struct spinlock*);
 void            initlock(struct spinlock*, char*);
+int             lockstatread(struct lockstat*, int);
 void            release(struct spinlock*);
 void            pushcli(void);
 void            popcli(void);
 
 // sleeplock.c
 void            acquiresleep(struct sleeplock*);
+void            acquiresleepshared(struct sleeplock*);
 void             releasesleep(struct sleeplock*);
+void            releasesleepshared(struct sleeplock*);
 int             holdingsleep(struct sleeplock*);
 void            initsleeplock(struct sleeplock*, char*);
 
@@ -150,6 +231,8 @@ int             argptr(int, char**, int);
 int             argstr(int, char**);
 int             fetchint(uint, int*);
 int             fetchstr(uint, char**);
+int             sysstatread(struct sysstat*, int);
+int             validuaddr(uint, uint);
 void            syscall(void);
 
 // timer.c
@@ -165,6 +248,17 @@ extern struct spinlock tickslock;
 void            uartinit(void);
 void            uartintr(void);
 void            uartputc(int);
+int             uartwrite(char*, int);
+
+// vdso.c
+void            vdsoinit(void);
+int             vdsomap(pde_t*, int);
+void            vdsotick(uint);
+
+// virtio.c
+int             virtioinit(void);
+int             virtiointr(int);
+void            virtiorw(struct buf**, int);
 
 // vm.c
 void            seginit(void);
@@ -176,12 +270,17 @@ int             deallocuvm(pde_t*, uint, uint);
 void            freevm(pde_t*);
 void            inituvm(pde_t*, char*, uint);
 int             loaduvm(pde_t*, char*, struct inode*, uint, uint);
-pde_t*          copyuvm(pde_t*, uint);
+pde_t*          copyuvm(pde_t*, uint, uint);
 void            switchuvm(struct proc*);
 void            switchkvm(void);
 int             copyout(pde_t*, uint, void*, uint);
 void            clearpteu(pde_t *pgdir, char *uva);
 int             mappages(pde_t *pgdir, void*, uint, uint, int);
+int             lazyalloc(pde_t*, uint);
 
 // number of elements in fixed-size array
 #define NELEM(x) (sizeof(x)/sizeof((x)[0]))
+
+// Record a trace event if its type is being traced.
+#define TRACEPOINT(type, a, b) \
+  do { if(tracemask & (1 << (type))) trace((type), (a), (b)); } while(0)
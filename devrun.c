@@ -0,0 +1,46 @@
+// Run a command with a recording device such as prof or trace on.
+
+#include "types.h"
+#include "stat.h"
+#include "user.h"
+#include "devrun.h"
+
+static char buf[2048];
+
+// Write start to the device open on fd, then run argv.  A child
+// runs the command and writes stop when it finishes; meanwhile
+// pass each size-byte record read from fd to fn, until the device
+// says it is done.  Messages begin with name.  Returns -1 if the
+// device refused start or fork failed.
+int
+devrun(char *name, int fd, char *start, char *stop, char **argv,
+       uint size, void (*fn)(void*))
+{
+  int i, n, pid;
+
+  if(write(fd, start, strlen(start)) < 0)
+    return -1;
+  if((pid = fork()) < 0){
+    printf(2, "%s: fork failed\n", name);
+    write(fd, stop, strlen(stop));
+    return -1;
+  }
+  if(pid == 0){
+    if((pid = fork()) == 0){
+      close(fd);
+      exec(argv[0], argv);
+      printf(2, "%s: exec %s failed\n", name, argv[0]);
+      exit();
+    }
+    if(pid > 0)
+      wait();
+    write(fd, stop, strlen(stop));
+    exit();
+  }
+
+  while((n = read(fd, buf, sizeof(buf) / size * size)) > 0)
+    for(i = 0; i + size <= n; i += size)
+      fn(buf + i);
+  wait();
+  return 0;
+}
@@ -0,0 +1,5 @@
+// Run a command with a recording device on, as prof and ktrace do.
+// See devrun.c.
+
+int devrun(char *name, int fd, char *start, char *stop, char **argv,
+           uint size, void (*fn)(void*));
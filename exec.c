@@ -16,7 +16,8 @@ exec(char *path, char **argv)
   struct elfhdr elf;
   struct inode *ip;
   struct proghdr ph;
-  pde_t *pgdir, *oldpgdir;
+  pde_t *pgdir;
+  struct vmspace *vm;
 
   begin_op();
 
@@ -24,8 +25,9 @@ exec(char *path, char **argv)
     end_op();
     return -1;
   }
-  ilock(ip);
+  ilockshared(ip);  // other execs of the same file can read it too
   pgdir = 0;
+  vm = 0;
 
   // Check ELF header
   if(readi(ip, (char*)&elf, 0, sizeof(elf)) < sizeof(elf))
@@ -35,6 +37,10 @@ exec(char *path, char **argv)
 
   if((pgdir = setupkvm()) == 0)
     goto bad;
+  if((vm = vmspacealloc()) == 0)
+    goto bad;
+  if(vdsomap(pgdir, proc->pid) < 0)
+    goto bad;
 
   // Load program into memory.
   sz = 0;
@@ -54,7 +60,7 @@ exec(char *path, char **argv)
     if(loaduvm(pgdir, (char*)ph.vaddr, ip, ph.off, ph.filesz) < 0)
       goto bad;
   }
-  iunlockput(ip);
+  iunlockputshared(ip);
   end_op();
   ip = 0;
 
@@ -92,20 +98,20 @@ exec(char *path, char **argv)
   safestrcpy(proc->name, last, sizeof(proc->name));
 
   // Commit to the user image.
-  oldpgdir = proc->pgdir;
-  proc->pgdir = pgdir;
   proc->sz = sz;
+  proc->shmsz = 0;
   proc->tf->eip = elf.entry;  // main
   proc->tf->esp = sp;
-  switchuvm(proc);
-  freevm(oldpgdir);
+  switchvm(pgdir, vm);
   return 0;
 
  bad:
   if(pgdir)
     freevm(pgdir);
+  if(vm)
+    vmspacefree(vm);
   if(ip){
-    iunlockput(ip);
+    iunlockputshared(ip);
     end_op();
   }
   return -1;
@@ -2,3 +2,8 @@
 #define O_WRONLY  0x001
 #define O_RDWR    0x002
 #define O_CREATE  0x200
+#define O_SYNC    0x400   // writes are durable when write() returns
+
+// eventfd() flags
+#define EFD_SEMAPHORE 0x1   // read takes 1, not the whole count
+#define EFD_NONBLOCK  0x2   // fail instead of sleeping
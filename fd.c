@@ -0,0 +1,141 @@
+// Per-process file descriptor tables.
+//
+// A descriptor is looked up in two steps: fd / NFDCHUNK picks a
+// chunk of NFDCHUNK file pointers, and fd % NFDCHUNK the entry
+// in it.  Chunks come from a slab cache when first needed and
+// go back when their last descriptor is closed, so a table
+// costs little until a process opens many files.  A bitmap of
+// open descriptors lets fdalloc() find the lowest free one a
+// word at a time.
+
+#include "types.h"
+#include "defs.h"
+#include "param.h"
+#include "mmu.h"
+#include "proc.h"
+
+static struct kmem_cache *chunkcache;
+
+void
+fdinit(void)
+{
+  chunkcache = kmem_cache_create("fdchunk", NFDCHUNK*sizeof(struct file*));
+}
+
+// Return the open file for descriptor fd, or 0.
+struct file*
+fd2file(int fd)
+{
+  struct file **c;
+
+  if(fd < 0 || fd >= NOFILE)
+    return 0;
+  if((c = proc->fdt.chunk[fd / NFDCHUNK]) == 0)
+    return 0;
+  return c[fd % NFDCHUNK];
+}
+
+// Allocate the lowest free file descriptor for f.
+// Takes over file reference from caller on success.
+// Returns the FD int on success, -1 on error.
+int
+fdalloc(struct file *f)
+{
+  struct fdtable *t;
+  struct file **c;
+  uint w;
+  int i, fd;
+
+  t = &proc->fdt;
+  for(i = 0; i < NOFILE/32; i++)
+    if(t->open[i] != 0xFFFFFFFF)
+      break;
+  if(i == NOFILE/32)
+    return -1;
+  fd = i * 32;
+  for(w = ~t->open[i]; !(w & 1); w >>= 1)
+    fd++;
+
+  if((c = t->chunk[fd / NFDCHUNK]) == 0){
+    if((c = kmem_cache_alloc(chunkcache)) == 0)
+      return -1;
+    memset(c, 0, NFDCHUNK*sizeof(struct file*));
+    t->chunk[fd / NFDCHUNK] = c;
+  }
+  c[fd % NFDCHUNK] = f;
+  t->open[fd / 32] |= 1U << (fd % 32);
+  return fd;
+}
+
+// Is any descriptor in chunk k of t open?
+static int
+chunkused(struct fdtable *t, int k)
+{
+  int i;
+
+  for(i = k * NFDCHUNK/32; i < (k+1) * NFDCHUNK/32; i++)
+    if(t->open[i])
+      return 1;
+  return 0;
+}
+
+// Forget open descriptor fd, without closing its file.
+void
+fdfree(int fd)
+{
+  struct fdtable *t;
+  int k;
+
+  t = &proc->fdt;
+  k = fd / NFDCHUNK;
+  t->chunk[k][fd % NFDCHUNK] = 0;
+  t->open[fd / 32] &= ~(1U << (fd % 32));
+  if(!chunkused(t, k)){
+    kmem_cache_free(chunkcache, t->chunk[k]);
+    t->chunk[k] = 0;
+  }
+}
+
+// Give np duplicates of p's open files.
+// Returns -1 if out of memory, leaving np with some of them.
+int
+fdcopy(struct proc *np, struct proc *p)
+{
+  struct file **c;
+  int k, i;
+
+  for(k = 0; k < NOFILE/NFDCHUNK; k++){
+    if(p->fdt.chunk[k] == 0)
+      continue;
+    if((c = kmem_cache_alloc(chunkcache)) == 0)
+      return -1;
+    for(i = 0; i < NFDCHUNK; i++){
+      c[i] = p->fdt.chunk[k][i];
+      if(c[i])
+        filedup(c[i]);
+    }
+    np->fdt.chunk[k] = c;
+    for(i = k * NFDCHUNK/32; i < (k+1) * NFDCHUNK/32; i++)
+      np->fdt.open[i] = p->fdt.open[i];
+  }
+  return 0;
+}
+
+// Close all of p's open files.
+void
+fdcloseall(struct proc *p)
+{
+  struct file **c;
+  int k, i;
+
+  for(k = 0; k < NOFILE/NFDCHUNK; k++){
+    if((c = p->fdt.chunk[k]) == 0)
+      continue;
+    for(i = 0; i < NFDCHUNK; i++)
+      if(c[i])
+        fileclose(c[i]);
+    kmem_cache_free(chunkcache, c);
+    p->fdt.chunk[k] = 0;
+  }
+  memset(p->fdt.open, 0, sizeof(p->fdt.open));
+}
@@ -9,39 +9,34 @@
 #include "spinlock.h"
 #include "sleeplock.h"
 #include "file.h"
+#include "uio.h"
+#include "stat.h"
 // #include "x86.h"  // For HW6, locks
 
 struct devsw devsw[NDEV];
 struct {
-  struct spinlock lock;
-  struct file file[NFILE];
+  struct spinlock lock;  // protects ref in every file
+  struct kmem_cache *cache;
 } ftable;
 
 void
 fileinit(void)
 {
   initlock(&ftable.lock, "ftable");
+  ftable.cache = kmem_cache_create("file", sizeof(struct file));
 }
 
-// Allocate a file structure in the global open-file table.
+// Allocate a file structure.
 struct file*
 filealloc(void)
 {
   struct file *f;
 
-  acquire(&ftable.lock);
-  // sti();  // For HW6
-  for(f = ftable.file; f < ftable.file + NFILE; f++){
-    if(f->ref == 0){
-      f->ref = 1;
-      // cli();  // For HW6
-      release(&ftable.lock);
-      return f;
-    }
-  }
-  // cli();  // For HW6
-  release(&ftable.lock);
-  return 0;
+  if((f = kmem_cache_alloc(ftable.cache)) == 0)
+    return 0;
+  memset(f, 0, sizeof(*f));
+  f->ref = 1;
+  return f;
 }
 
 // Increment ref count for file f.
@@ -71,13 +66,14 @@ fileclose(struct file *f)
   }
   // Refcount is now 0
   ff = *f;
-  f->ref = 0;
-  f->type = FD_NONE;
   release(&ftable.lock);
+  kmem_cache_free(ftable.cache, f);
 
-  // Clean up if pipe or inode
+  // Clean up if pipe, semaphore or inode
   if(ff.type == FD_PIPE)
     pipeclose(ff.pipe, ff.writable);
+  else if(ff.type == FD_SEM)
+    semclose(ff.sem);
   else if(ff.type == FD_INODE){
     begin_op();
     iput(ff.ip);
@@ -90,45 +86,97 @@ int
 filestat(struct file *f, struct stat *st)
 {
   if(f->type == FD_INODE){
-    ilock(f->ip);
+    ilockshared(f->ip);
     stati(f->ip, st);
-    iunlock(f->ip);
+    iunlockshared(f->ip);
     return 0;
   }
   return -1;
 }
 
-// Read from file f.
+// Read from file f into the n buffers in iov, at offset off,
+// or at and advancing f->off if off < 0.  A short read, or any
+// data from a pipe or device, ends the list early, so that readv
+// does not block once it has something.  Returns the number of
+// bytes read.
 int
-fileread(struct file *f, char *addr, int n)
+filereadv(struct file *f, struct iovec *iov, int n, int off)
 {
-  int r;
+  int i, r, tot, shared;
+  uint pos;
 
   if(f->readable == 0)
     return -1;
-  if(f->type == FD_PIPE)
-    return piperead(f->pipe, addr, n);
+  if(off >= 0 && f->type != FD_INODE)
+    return -1;
+  r = tot = 0;
   if(f->type == FD_INODE){
-    ilock(f->ip);
-    if((r = readi(f->ip, addr, f->off, n)) > 0)
-      f->off += r;
-    iunlock(f->ip);
-    return r;
+    // Readers share the inode lock, unless another reader
+    // could be using the same f->off, or the inode is a
+    // device, whose read routine unlocks and relocks it.
+    shared = (off >= 0 || f->ref == 1) && f->ip->type != T_DEV;
+    if(shared)
+      ilockshared(f->ip);
+    else
+      ilock(f->ip);
+    pos = off < 0 ? f->off : off;
+    for(i = 0; i < n; i++){
+      if((r = readi(f->ip, iov[i].base, pos + tot, iov[i].len)) < 0)
+        break;
+      tot += r;
+      // A device read may block; stop once there is data.
+      if(r < iov[i].len || (f->ip->type == T_DEV && tot > 0))
+        break;
+    }
+    if(off < 0)
+      f->off += tot;
+    if(shared)
+      iunlockshared(f->ip);
+    else
+      iunlock(f->ip);
+    return r < 0 && tot == 0 ? -1 : tot;
+  }
+  // Pipes and semaphores block until there is data, so
+  // fill only the first non-empty buffer.
+  for(i = 0; i < n; i++){
+    if(iov[i].len == 0)
+      continue;
+    if(f->type == FD_PIPE)
+      return piperead(f->pipe, iov[i].base, iov[i].len);
+    else if(f->type == FD_SEM)
+      return semread(f->sem, iov[i].base, iov[i].len);
+    else
+      panic("fileread");
   }
-  panic("fileread");
+  return 0;
+}
+
+// Read from file f.
+int
+fileread(struct file *f, char *addr, int n)
+{
+  struct iovec iov;
+
+  iov.base = addr;
+  iov.len = n;
+  return filereadv(f, &iov, 1, -1);
 }
 
 //PAGEBREAK!
-// Write to file f.
+// Write the n buffers in iov to file f, at offset off, or at
+// and advancing f->off if off < 0.  Returns the number of
+// bytes written, or -1 if not all of them could be.
 int
-filewrite(struct file *f, char *addr, int n)
+filewritev(struct file *f, struct iovec *iov, int n, int off)
 {
-  int r;
+  int i, r, n1, tot, done, budget;
+  uint pos;
 
   if(f->writable == 0)
     return -1;
-  if(f->type == FD_PIPE)
-    return pipewrite(f->pipe, addr, n);
+  if(off >= 0 && f->type != FD_INODE)
+    return -1;
+  r = tot = 0;
   if(f->type == FD_INODE){
     // write a few blocks at a time to avoid exceeding
     // the maximum log transaction size, including
@@ -136,28 +184,64 @@ filewrite(struct file *f, char *addr, int n)
     // and 2 blocks of slop for non-aligned writes.
     // this really belongs lower down, since writei()
     // might be writing a device like the console.
-    int max = ((LOGSIZE-1-1-2) / 2) * 512;
-    int i = 0;
+    // The buffers go to consecutive offsets, so as
+    // many as fit can share one transaction.
+    int max = ((LOGSIZE-1-1-2) / 2) * BSIZE;
+    i = done = 0;
     while(i < n){
-      int n1 = n - i;
-      if(n1 > max)
-        n1 = max;
-
       begin_op();
       ilock(f->ip);
-      // writei also writes to the transaction log
-      if ((r = writei(f->ip, addr + i, f->off, n1)) > 0)
-        f->off += r;
+      pos = off < 0 ? f->off : off + tot;
+      for(budget = max; i < n && budget > 0; budget -= r){
+        n1 = iov[i].len - done;
+        if(n1 > budget)
+          n1 = budget;
+        // writei also writes to the transaction log
+        if((r = writei(f->ip, (char*)iov[i].base + done, pos, n1)) < 0)
+          break;
+        if(r != n1)
+          panic("short filewrite");
+        pos += r;
+        tot += r;
+        done += r;
+        if(done == iov[i].len){
+          i++;
+          done = 0;
+        }
+      }
+      if(off < 0)
+        f->off = pos;
       iunlock(f->ip);
       end_op();
 
       if(r < 0)
         break;
-      if(r != n1)
-        panic("short filewrite");
-      i += r;
     }
-    return i == n ? n : -1;
+    if(f->sync)
+      log_sync();
+    return i == n ? tot : -1;
+  }
+  for(i = 0; i < n; i++){
+    if(f->type == FD_PIPE)
+      r = pipewrite(f->pipe, iov[i].base, iov[i].len);
+    else if(f->type == FD_SEM)
+      r = semwrite(f->sem, iov[i].base, iov[i].len);
+    else
+      panic("filewrite");
+    if(r < 0)
+      return -1;
+    tot += r;
   }
-  panic("filewrite");
+  return tot;
+}
+
+// Write to file f.
+int
+filewrite(struct file *f, char *addr, int n)
+{
+  struct iovec iov;
+
+  iov.base = addr;
+  iov.len = n;
+  return filewritev(f, &iov, 1, -1);
 }
@@ -1,12 +1,13 @@
 // This is what a file descriptor refers to.
-// These all live in the global open file table
-// ftable--see file.c
+// They are allocated from ftable's slab cache--see file.c
 struct file {
-  enum { FD_NONE, FD_PIPE, FD_INODE } type;
+  enum { FD_NONE, FD_PIPE, FD_INODE, FD_SEM } type;
   int ref; // reference count
   char readable;
   char writable;
+  char sync;      // O_SYNC: commit after each write
   struct pipe *pipe;
+  struct sem *sem;
   struct inode *ip;
   uint off;
 };
@@ -26,6 +27,7 @@ struct inode {
   short nlink;        // num hard links
   uint size;
   uint addrs[NDIRECT+2];
+  struct inode *next; // icache hash chain
 };
 #define I_VALID 0x2
 
@@ -0,0 +1,119 @@
+// Process table scaling benchmark.  Grows the number of
+// processes (sleeping on a pipe) by doubling, and at each size
+// times a simple system call, kill() of a pid that does not
+// exist, and fork() plus wait().  With the pid hash and child
+// lists the times should stay flat as the table grows.
+//
+// usage: forkbench [maxprocs]
+
+#include "types.h"
+#include "stat.h"
+#include "user.h"
+
+#define NCALL 10000
+#define NFORK 200
+
+int hold[2];
+
+// Start up to n more sleeping processes, and return how many
+// started.  They are made by a helper that exits, so that they
+// belong to init, not to us, and our own wait() has nothing
+// extra to look through.  The helper sends its count on a pipe.
+int
+spawn(int n)
+{
+  int i, pid, done[2];
+  char c;
+
+  if(pipe(done) < 0)
+    return 0;
+  if((pid = fork()) < 0){
+    close(done[0]);
+    close(done[1]);
+    return 0;
+  }
+  if(pid == 0){
+    close(done[0]);
+    for(i = 0; i < n; i++){
+      if((pid = fork()) < 0)
+        break;
+      if(pid == 0){
+        close(done[1]);
+        close(hold[1]);
+        read(hold[0], &c, 1);  // until forkbench closes hold[1]
+        exit();
+      }
+    }
+    write(done[1], &i, sizeof(i));
+    exit();
+  }
+  close(done[1]);
+  if(read(done[0], &i, sizeof(i)) != sizeof(i))
+    i = 0;
+  close(done[0]);
+  wait();
+  return i;
+}
+
+// Print the time per call for n calls in us microseconds.
+void
+report(char *what, int n, uint us)
+{
+  printf(1, " %s %d ns", what, us * 100 / n * 10);
+}
+
+int
+main(int argc, char *argv[])
+{
+  int i, n, have, max, pid;
+  uint t0;
+
+  max = 256;
+  if(argc > 1)
+    max = atoi(argv[1]);
+  if(max <= 0){
+    printf(2, "usage: forkbench [maxprocs]\n");
+    exit();
+  }
+  if(pipe(hold) < 0){
+    printf(2, "forkbench: pipe failed\n");
+    exit();
+  }
+
+  have = 0;
+  for(n = 1; n <= max; n *= 2){
+    have += spawn(n - have);
+    if(have < n){
+      printf(1, "forkbench: fork failed at %d procs\n", have);
+      break;
+    }
+    printf(1, "%d procs:", n);
+
+    t0 = vmicros();
+    for(i = 0; i < NCALL; i++)
+      uptime();
+    report("uptime", NCALL, vmicros() - t0);
+
+    t0 = vmicros();
+    for(i = 0; i < NCALL; i++)
+      kill(1000000);
+    report("kill", NCALL, vmicros() - t0);
+
+    t0 = vmicros();
+    for(i = 0; i < NFORK; i++){
+      if((pid = fork()) < 0){
+        printf(1, " fork failed\n");
+        break;
+      }
+      if(pid == 0)
+        exit();
+      wait();
+    }
+    report("fork+wait", NFORK, vmicros() - t0);
+    printf(1, "\n");
+  }
+
+  close(hold[0]);
+  close(hold[1]);
+  exit();
+}
@@ -157,20 +157,23 @@ bfree(int dev, uint b)
 // have locked the inodes involved; this lets callers create
 // multi-step atomic operations.
 
+#define NIHASH 61
+#define IHASH(dev, inum) (((dev) * 31 + (inum)) % NIHASH)
+
+// Inodes with references, hashed by dev and inum.  An inode
+// is allocated from the cache by iget() and freed when the
+// last reference is dropped.
 struct {
   struct spinlock lock;
-  struct inode inode[NINODE];
+  struct kmem_cache *cache;
+  struct inode *hash[NIHASH];
 } icache;
 
 void
 iinit(int dev)
 {
-  int i = 0;
-
   initlock(&icache.lock, "icache");
-  for(i = 0; i < NINODE; i++) {
-    initsleeplock(&icache.inode[i].lock, "inode");
-  }
+  icache.cache = kmem_cache_create("inode", sizeof(struct inode));
 
   readsb(dev, &sb);
   cprintf("sb: size %d nblocks %d ninodes %d nlog %d logstart %d\
@@ -228,7 +231,7 @@ iupdate(struct inode *ip)
   brelse(bp);
 }
 
-// Get the icache entry for an inode, or an empty
+// Get the icache entry for an inode, or a new
 // cache entry if it's not in there, containing the
 // desired inum and ready to be populated with `ilock`.
 // Does not lock the inode and does not read it from disk,
@@ -238,34 +241,42 @@ iupdate(struct inode *ip)
 static struct inode*
 iget(uint dev, uint inum)
 {
-  struct inode *ip, *empty;
+  struct inode *ip, *new;
+  int h;
 
+  h = IHASH(dev, inum);
+  new = 0;
   acquire(&icache.lock);
-
-  // Is the inode already cached?
-  empty = 0;
-  for(ip = &icache.inode[0]; ip < &icache.inode[NINODE]; ip++){
-    if(ip->ref > 0 && ip->dev == dev && ip->inum == inum){
-      ip->ref++;
-      release(&icache.lock);
-      return ip;
+  for(;;){
+    // Is the inode already cached?
+    for(ip = icache.hash[h]; ip; ip = ip->next){
+      if(ip->dev == dev && ip->inum == inum){
+        ip->ref++;
+        release(&icache.lock);
+        if(new)
+          kmem_cache_free(icache.cache, new);
+        return ip;
+      }
     }
-    if(empty == 0 && ip->ref == 0)    // Remember empty slot.
-      empty = ip;
-  }
-
-  // Recycle an inode cache entry.
-  if(empty == 0)
-    panic("iget: no inodes");
+    if(new)
+      break;
 
-  ip = empty;
-  ip->dev = dev;
-  ip->inum = inum;
-  ip->ref = 1;
-  ip->flags = 0;
+    // Allocate an entry without the lock, then look again.
+    release(&icache.lock);
+    if((new = kmem_cache_alloc(icache.cache)) == 0)
+      panic("iget: no inodes");
+    initsleeplock(&new->lock, "inode");
+    new->dev = dev;
+    new->inum = inum;
+    new->ref = 1;
+    new->flags = 0;
+    acquire(&icache.lock);
+  }
+  new->next = icache.hash[h];
+  icache.hash[h] = new;
   release(&icache.lock);
 
-  return ip;
+  return new;
 }
 
 // Increment reference count for ip.
@@ -308,6 +319,34 @@ ilock(struct inode *ip)
   }
 }
 
+// Lock the given inode shared with other readers, who may
+// look at but not change it.
+void
+ilockshared(struct inode *ip)
+{
+  if(ip == 0 || ip->ref < 1)
+    panic("ilockshared");
+
+  acquiresleepshared(&ip->lock);
+  while(!(ip->flags & I_VALID)){
+    // Reading the inode in needs the lock to itself.
+    releasesleepshared(&ip->lock);
+    ilock(ip);
+    iunlock(ip);
+    acquiresleepshared(&ip->lock);
+  }
+}
+
+// Unlock an inode locked with ilockshared.
+void
+iunlockshared(struct inode *ip)
+{
+  if(ip == 0 || !holdingsleep(&ip->lock) || ip->ref < 1)
+    panic("iunlockshared");
+
+  releasesleepshared(&ip->lock);
+}
+
 // Unlock the given inode.
 void
 iunlock(struct inode *ip)
@@ -319,8 +358,8 @@ iunlock(struct inode *ip)
 }
 
 // Drop a reference to an in-memory inode.
-// If that was the last reference, the inode cache entry can
-// be recycled.
+// If that was the last reference, the inode cache entry is
+// freed.
 // If that was the last reference and the inode has no links
 // to it, free the inode (and its content) on disk.
 // All calls to iput() must be inside a transaction in
@@ -328,6 +367,8 @@ iunlock(struct inode *ip)
 void
 iput(struct inode *ip)
 {
+  struct inode **pp;
+
   acquire(&icache.lock);
   if(ip->ref == 1 && (ip->flags & I_VALID) && ip->nlink == 0){
     // inode has no links and no other references: truncate and free.
@@ -338,8 +379,15 @@ iput(struct inode *ip)
     acquire(&icache.lock);
     ip->flags = 0;
   }
-  ip->ref--;
+  if(--ip->ref > 0){
+    release(&icache.lock);
+    return;
+  }
+  for(pp = &icache.hash[IHASH(ip->dev, ip->inum)]; *pp != ip; pp = &(*pp)->next)
+    ;
+  *pp = ip->next;
   release(&icache.lock);
+  kmem_cache_free(icache.cache, ip);
 }
 
 // Common idiom: unlock, then put.
@@ -350,6 +398,13 @@ iunlockput(struct inode *ip)
   iput(ip);
 }
 
+void
+iunlockputshared(struct inode *ip)
+{
+  iunlockshared(ip);
+  iput(ip);
+}
+
 //PAGEBREAK!
 // Inode content
 //
@@ -539,7 +594,9 @@ writei(struct inode *ip, char *src, uint off, uint n)
 
   if(off > ip->size || off + n < off)
     return -1;
-  if(off + n > MAXFILE*BSIZE)
+  // MAXFILE*BSIZE does not fit in a uint for large BSIZE,
+  // so compare in blocks.
+  if((off + n + BSIZE - 1) / BSIZE > MAXFILE)
     return -1;
 
   for(tot=0; tot<n; tot+=m, off+=m, src+=m){
@@ -705,25 +762,26 @@ namex(char *path, int nameiparent, char *name)
     ip = idup(proc->cwd);
 
   // Iterate through path tokens, saving them
-  // to `name`
+  // to `name`.  Lookups only read the directories,
+  // so they share the locks.
   while((path = skipelem(path, name)) != 0){
-    ilock(ip);
+    ilockshared(ip);
     if(ip->type != T_DIR){
-      iunlockput(ip);
+      iunlockputshared(ip);
       return 0;
     }
     if(nameiparent && *path == '\0'){
       // Stop one level early, return
       // inode of parent containing target
-      iunlock(ip);
+      iunlockshared(ip);
       return ip;
     }
     if((next = dirlookup(ip, name, 0)) == 0){
       // Token not found in current directory
-      iunlockput(ip);
+      iunlockputshared(ip);
       return 0;
     }
-    iunlockput(ip);
+    iunlockputshared(ip);
     ip = next;
   }
   if(nameiparent){
@@ -3,7 +3,7 @@
 
 
 #define ROOTINO 1  // root i-number
-#define BSIZE 512  // block size
+#define BSIZE 4096  // block size: a page, or 8 disk sectors
 
 // Disk layout:
 // [ boot block | super block | log | inode blocks |
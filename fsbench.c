@@ -0,0 +1,105 @@
+// File system throughput benchmark.  Writes a file sequentially,
+// reads it back, then creates and deletes a batch of small
+// files, and reports bytes/s and files/s.  Compare a kernel
+// built with BSIZE 512 against one built with BSIZE 4096.
+//
+// usage: fsbench [kbytes [chunk]]
+
+#include "types.h"
+#include "stat.h"
+#include "user.h"
+#include "fcntl.h"
+
+#define NSMALL 100
+
+char buf[16*1024];
+
+// Print bytes/s for n bytes in t ticks (10ms each).
+void
+rate(char *what, uint n, int t)
+{
+  if(t == 0){
+    printf(1, "%s: %d bytes in 0 ticks; use more bytes\n", what, n);
+    return;
+  }
+  printf(1, "%s: %d bytes in %d ticks: %d bytes/s\n",
+         what, n, t, n / t * 100 + n % t * 100 / t);
+}
+
+int
+main(int argc, char *argv[])
+{
+  int fd, i, n, total, chunk, t0, t;
+  char name[8];
+
+  total = 2048;
+  chunk = 4096;
+  if(argc > 1)
+    total = atoi(argv[1]);
+  if(argc > 2)
+    chunk = atoi(argv[2]);
+  if(total <= 0 || chunk <= 0 || chunk > sizeof(buf)){
+    printf(2, "usage: fsbench [kbytes [chunk]]\n");
+    exit();
+  }
+  total *= 1024;
+  for(i = 0; i < sizeof(buf); i++)
+    buf[i] = 'a' + i % 26;
+
+  unlink("fsbench.tmp");
+  fd = open("fsbench.tmp", O_CREATE|O_RDWR);
+  if(fd < 0){
+    printf(2, "fsbench: cannot create fsbench.tmp\n");
+    exit();
+  }
+  t0 = uptime();
+  for(n = 0; n < total; n += chunk){
+    if(write(fd, buf, chunk) != chunk){
+      printf(2, "fsbench: write failed at %d\n", n);
+      exit();
+    }
+  }
+  t = uptime() - t0;
+  close(fd);
+  rate("write", total, t);
+
+  fd = open("fsbench.tmp", O_RDONLY);
+  t0 = uptime();
+  for(n = 0; n < total; n += i){
+    if((i = read(fd, buf, chunk)) <= 0){
+      printf(2, "fsbench: read failed at %d\n", n);
+      exit();
+    }
+  }
+  t = uptime() - t0;
+  close(fd);
+  unlink("fsbench.tmp");
+  rate("read", total, t);
+
+  // Small files: mostly inode, directory and bitmap traffic.
+  name[0] = 'f';
+  name[3] = 0;
+  t0 = uptime();
+  for(i = 0; i < NSMALL; i++){
+    name[1] = '0' + i / 10;
+    name[2] = '0' + i % 10;
+    if((fd = open(name, O_CREATE|O_WRONLY)) < 0){
+      printf(2, "fsbench: cannot create %s\n", name);
+      exit();
+    }
+    write(fd, buf, 100);
+    close(fd);
+  }
+  for(i = 0; i < NSMALL; i++){
+    name[1] = '0' + i / 10;
+    name[2] = '0' + i % 10;
+    unlink(name);
+  }
+  t = uptime() - t0;
+  if(t > 0)
+    printf(1, "small: %d files created and removed in %d ticks: %d files/s\n",
+           NSMALL, t, NSMALL * 100 / t);
+  else
+    printf(1, "small: %d files in 0 ticks\n", NSMALL);
+  exit();
+}
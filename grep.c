@@ -3,19 +3,36 @@
 #include "types.h"
 #include "stat.h"
 #include "user.h"
+#include "fcntl.h"
+#include "ring.h"
+
+// Files named on the command line are read NREAD blocks
+// at a time with ring_enter(), with the open in the first
+// batch.  Standard input is read a block at a time, so that
+// matches from a terminal show up at once.
+#define NREAD 8
+#define OPENED 0xffffffff
 
 char buf[1024];
+int m;
+char blk[NREAD][512];
+struct ring ring;
 int match(char*, char*);
 
+// Append n bytes at p to buf and print the
+// complete lines in buf that match pattern.
 void
-grep(char *pattern, int fd)
+scan(char *pattern, char *p0, int n)
 {
-  int n, m;
+  int k;
   char *p, *q;
 
-  m = 0;
-  while((n = read(fd, buf+m, sizeof(buf)-m-1)) > 0){
-    m += n;
+  while(n > 0){
+    k = n < sizeof(buf)-m-1 ? n : sizeof(buf)-m-1;
+    memmove(buf+m, p0, k);
+    p0 += k;
+    n -= k;
+    m += k;
     buf[m] = '\0';
     p = buf;
     while((q = strchr(p, '\n')) != 0){
@@ -26,7 +43,7 @@ grep(char *pattern, int fd)
       }
       p = q+1;
     }
-    if(p == buf)
+    if(p == buf && m == sizeof(buf)-1)
       m = 0;
     if(m > 0){
       m -= p - buf;
@@ -35,10 +52,49 @@ grep(char *pattern, int fd)
   }
 }
 
+// Grep fd, or if fd is -1 the file called name.
+void
+grep(char *pattern, int fd, char *name)
+{
+  struct cqe c;
+  int b, nread, eof, link, opened;
+
+  m = 0;
+  link = 0;
+  opened = fd < 0;
+  if(opened){
+    ringput(&ring, RING_OPEN, 0, 0, name, O_RDONLY, OPENED);
+    link = RING_LINK;
+  }
+  nread = opened ? NREAD : 1;
+  eof = 0;
+  while(!eof){
+    for(b = 0; b < nread; b++)
+      ringput(&ring, RING_READ, link, fd, blk[b], sizeof(blk[b]), b);
+    ring_enter(&ring);
+    link = 0;
+    while(ringget(&ring, &c)){
+      if(c.data == OPENED){
+        if((fd = c.res) < 0){
+          printf(1, "grep: cannot open %s\n", name);
+          exit();
+        }
+        continue;
+      }
+      if(c.res <= 0)
+        eof = 1;
+      if(!eof)
+        scan(pattern, blk[c.data], c.res);
+    }
+  }
+  if(opened)
+    close(fd);
+}
+
 int
 main(int argc, char *argv[])
 {
-  int fd, i;
+  int i;
   char *pattern;
 
   if(argc <= 1){
@@ -48,18 +104,12 @@ main(int argc, char *argv[])
   pattern = argv[1];
 
   if(argc <= 2){
-    grep(pattern, 0);
+    grep(pattern, 0, "");
     exit();
   }
 
-  for(i = 2; i < argc; i++){
-    if((fd = open(argv[i], 0)) < 0){
-      printf(1, "grep: cannot open %s\n", argv[i]);
-      exit();
-    }
-    grep(pattern, fd);
-    close(fd);
-  }
+  for(i = 2; i < argc; i++)
+    grep(pattern, -1, argv[i]);
   exit();
 }
 
@@ -1,4 +1,5 @@
-// Simple PIO-based (non-DMA) interrupt-driven IDE driver code.
+// Simple interrupt-driven IDE driver code.  Uses PCI bus-master
+// DMA when the controller supports it, PIO otherwise.
 
 #include "types.h"
 #include "defs.h"
@@ -12,6 +13,8 @@
 #include "sleeplock.h"
 #include "fs.h"
 #include "buf.h"
+#include "pci.h"
+#include "trace.h"
 
 #define SECTOR_SIZE   512
 #define IDE_BSY       0x80
@@ -23,10 +26,34 @@
 #define IDE_CMD_WRITE 0x30
 #define IDE_CMD_RDMUL 0xc4
 #define IDE_CMD_WRMUL 0xc5
+#define IDE_CMD_SETMUL 0xc6
+#define IDE_CMD_RDDMA 0xc8
+#define IDE_CMD_WRDMA 0xca
+
+#define IDE_MAXMUL    16  // most sectors per READ/WRITE MULTIPLE
 
 #define IDE_REG_STATUS 0x1F7  // Status register
 #define IDE_REG_CTRL 0x3F6  // Control register
 
+// Bus-master registers for the primary channel, at bmbase.
+#define BM_CMD        0  // Command register
+#define BM_STATUS     2  // Status register
+#define BM_PRDT       4  // Physical address of the PRD table
+
+#define BM_CMD_START  0x01  // Start the transfer
+#define BM_CMD_READ   0x08  // Transfer from disk to memory
+#define BM_ST_ERR     0x02  // Transfer failed (write 1 to clear)
+#define BM_ST_INTR    0x04  // Disk interrupted (write 1 to clear)
+
+// Physical region descriptor: one physically contiguous piece
+// of the buffer, which must not cross a 64 KB boundary.
+struct prd {
+  uint addr;
+  ushort len;      // 0 means 64 KB
+  ushort flags;
+};
+#define PRD_EOT       0x8000  // Last entry in the table
+
 // idequeue points to the buf now being read/written to the disk.
 // idequeue->qnext points to the next buf to be processed.
 // You must hold idelock while manipulating queue.
@@ -35,7 +62,11 @@ static struct spinlock idelock;
 static struct buf *idequeue;
 
 static int havedisk1;
+static int havevirtio;
+static ushort bmbase;  // bus-master registers, or 0 to use PIO
+static struct prd prdt[BSIZE/0x10000 + 2] __attribute__((aligned(32)));
 static void idestart(struct buf*);
+static void idedmainit(void);
 
 // Wait for IDE disk to become ready.
 static int
@@ -69,8 +100,67 @@ ideinit(void)
     }
   }
 
+  // A block larger than a sector moves with one READ/WRITE
+  // MULTIPLE command, and one interrupt, per block; tell each
+  // disk how many sectors that is.  Interrupts are off (nIEN)
+  // so the command completions are not taken as requests.
+  if(BSIZE > SECTOR_SIZE){
+    outb(IDE_REG_CTRL, 2);
+    for(i = 0; i <= havedisk1; i++){
+      outb(0x1f6, 0xe0 | (i<<4));
+      outb(0x1f2, BSIZE/SECTOR_SIZE);
+      outb(IDE_REG_STATUS, IDE_CMD_SETMUL);
+      if(idewait(1) < 0)
+        panic("ideinit: set multiple");
+    }
+  }
+
   // Switch back to disk 0.
   outb(0x1f6, 0xe0 | (0<<4));
+
+  idedmainit();
+  havevirtio = virtioinit() == 0;
+}
+
+// Look for a PCI IDE controller that can do bus-master DMA,
+// and if there is one, let it.
+static void
+idedmainit(void)
+{
+  struct pcidev d;
+
+  if(pcifind(&d, PCI_ANY, PCI_ANY, PCI_CLASS_STORAGE, PCI_SUBCLASS_IDE) < 0)
+    return;
+  // Prog if bit 7: bus master; BAR4 must be an I/O space address.
+  if(!(d.progif & 0x80) || !(d.bar[4] & 1) || (d.bar[4] & ~3) == 0)
+    return;
+  pciwrite(&d, PCI_COMMAND,
+           pciread(&d, PCI_COMMAND) | PCI_CMD_IO | PCI_CMD_MASTER);
+  bmbase = d.bar[4] & ~3;
+}
+
+// Point the PRD table at b's data, splitting it
+// wherever it crosses a 64 KB boundary.
+static void
+prdfill(struct buf *b)
+{
+  struct prd *p;
+  uint pa, n, m;
+
+  pa = V2P(b->data);
+  for(p = prdt, n = BSIZE; ; p++){
+    m = 0x10000 - (pa & 0xffff);
+    if(m > n)
+      m = n;
+    p->addr = pa;
+    p->len = m;
+    p->flags = 0;
+    pa += m;
+    n -= m;
+    if(n == 0)
+      break;
+  }
+  p->flags = PRD_EOT;
 }
 
 // Start the request for b.  Caller must hold idelock.
@@ -86,7 +176,15 @@ idestart(struct buf *b)
   int read_cmd = (sector_per_block == 1) ? IDE_CMD_READ :  IDE_CMD_RDMUL;
   int write_cmd = (sector_per_block == 1) ? IDE_CMD_WRITE : IDE_CMD_WRMUL;
 
-  if (sector_per_block > 7) panic("idestart");
+  if(sector_per_block > IDE_MAXMUL)
+    panic("idestart: block too big");
+
+  if(bmbase){
+    prdfill(b);
+    outl(bmbase+BM_PRDT, V2P(prdt));
+    outb(bmbase+BM_CMD, (b->flags & B_DIRTY) ? 0 : BM_CMD_READ);
+    outb(bmbase+BM_STATUS, BM_ST_ERR|BM_ST_INTR);
+  }
 
   idewait(0);
   outb(IDE_REG_CTRL, 0);  // generate interrupt
@@ -95,7 +193,11 @@ idestart(struct buf *b)
   outb(0x1f4, (sector >> 8) & 0xff);  // LBA mid byte
   outb(0x1f5, (sector >> 16) & 0xff);  // LBA hi byte
   outb(0x1f6, 0xe0 | ((b->dev&1)<<4) | ((sector>>24)&0x0f));
-  if(b->flags & B_DIRTY){
+  if(bmbase){
+    // The controller moves the data; the disk interrupts when done.
+    outb(IDE_REG_STATUS, (b->flags & B_DIRTY) ? IDE_CMD_WRDMA : IDE_CMD_RDDMA);
+    outb(bmbase+BM_CMD, inb(bmbase+BM_CMD) | BM_CMD_START);
+  } else if(b->flags & B_DIRTY){
     // Flush
     outb(IDE_REG_STATUS, write_cmd);
     outsl(0x1f0, b->data, BSIZE/4);
@@ -110,6 +212,7 @@ void
 ideintr(void)
 {
   struct buf *b;
+  int st;
 
   // First queued buffer is the active request.
   acquire(&idelock);
@@ -120,9 +223,17 @@ ideintr(void)
   }
   idequeue = b->qnext;
 
-  // Read data if needed.
-  if(!(b->flags & B_DIRTY) && idewait(1) >= 0)
+  if(bmbase){
+    // Stop the controller and acknowledge the interrupt.
+    st = inb(bmbase+BM_STATUS);
+    outb(bmbase+BM_CMD, 0);
+    outb(bmbase+BM_STATUS, BM_ST_ERR|BM_ST_INTR);
+    if(idewait(1) < 0 || (st & BM_ST_ERR))
+      panic("ideintr: dma error");
+  } else if(!(b->flags & B_DIRTY) && idewait(1) >= 0){
+    // Read data if needed.
     insl(0x1f0, b->data, BSIZE/4);
+  }
 
   // Wake process waiting for this buf.
   b->flags |= B_VALID;
@@ -143,31 +254,62 @@ ideintr(void)
 void
 iderw(struct buf *b)
 {
-  struct buf **pp;
+  iderwv(&b, 1);
+}
+
+// Sync the n buffers in bs, all on the same disk, with
+// the disk, queueing them all before waiting for any.
+void
+iderwv(struct buf **bs, int n)
+{
+  struct buf *b, **pp;
+  int i;
 
-  if(!holdingsleep(&b->lock))
-    panic("iderw: buf not locked");
-  if((b->flags & (B_VALID|B_DIRTY)) == B_VALID)
-    panic("iderw: nothing to do");
-  if(b->dev != 0 && !havedisk1)
+  for(i = 0; i < n; i++){
+    b = bs[i];
+    if(!holdingsleep(&b->lock))
+      panic("iderw: buf not locked");
+    if((b->flags & (B_VALID|B_DIRTY)) == B_VALID)
+      panic("iderw: nothing to do");
+    if(b->dev != bs[0]->dev)
+      panic("iderw: mixed disks");
+  }
+  if(n == 0)
+    return;
+  for(i = 0; i < n; i++)
+    TRACEPOINT(TR_DISK, bs[i]->blockno, (bs[i]->flags & B_DIRTY) != 0);
+  // A virtio disk, if there is one, stands in for disk 1.
+  if(bs[0]->dev != 0 && havevirtio){
+    virtiorw(bs, n);
+    for(i = 0; i < n; i++)
+      TRACEPOINT(TR_DISKDONE, bs[i]->blockno, 0);
+    return;
+  }
+  if(bs[0]->dev != 0 && !havedisk1)
     panic("iderw: ide disk 1 not present");
 
   acquire(&idelock);  //DOC:acquire-lock
   // sti();  // For hw6_locks
 
-  // Append b to idequeue.
-  b->qnext = 0;
-  for(pp=&idequeue; *pp; pp=&(*pp)->qnext)  //DOC:insert-queue
-    ;
-  *pp = b;
+  for(i = 0; i < n; i++){
+    b = bs[i];
+    // Append b to idequeue.
+    b->qnext = 0;
+    for(pp=&idequeue; *pp; pp=&(*pp)->qnext)  //DOC:insert-queue
+      ;
+    *pp = b;
 
-  // Start disk if necessary.
-  if(idequeue == b)
-    idestart(b);
+    // Start disk if necessary.
+    if(idequeue == b)
+      idestart(b);
+  }
 
-  // Wait for request to finish.
-  while((b->flags & (B_VALID|B_DIRTY)) != B_VALID){
-    sleep(b, &idelock);
+  // Wait for requests to finish.
+  for(i = 0; i < n; i++){
+    while((bs[i]->flags & (B_VALID|B_DIRTY)) != B_VALID){
+      sleep(bs[i], &idelock);
+    }
+    TRACEPOINT(TR_DISKDONE, bs[i]->blockno, 0);
   }
 
   // cli();  // For hw6_locks
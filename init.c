@@ -4,13 +4,15 @@
 #include "stat.h"
 #include "user.h"
 #include "fcntl.h"
+#include "prof.h"
+#include "trace.h"
 
 char *argv[] = { "sh", 0 };
 
 int
 main(void)
 {
-  int pid, wpid;
+  int pid, wpid, fd;
 
   if(open("console", O_RDWR) < 0){
     mknod("console", 1, 1);
@@ -18,6 +20,14 @@ main(void)
   }
   dup(0);  // stdout
   dup(0);  // stderr
+  if((fd = open("prof", O_RDONLY)) < 0)
+    mknod("prof", PROF, 0);
+  else
+    close(fd);
+  if((fd = open("trace", O_RDONLY)) < 0)
+    mknod("trace", TRACE, 0);
+  else
+    close(fd);
 
   for(;;){
     printf(1, "init: starting sh\n");
@@ -1,6 +1,9 @@
 // Physical memory allocator, intended to allocate
 // memory for user processes, kernel stacks, page table pages,
 // and pipe buffers. Allocates 4096-byte pages.
+//
+// Idle CPUs zero free pages ahead of time and keep them on a
+// separate list, so that kalloc_zeroed() usually need not.
 
 #include "types.h"
 #include "defs.h"
@@ -12,6 +15,8 @@
 void freerange(void *vstart, void *vend);
 extern char end[]; // first address after kernel loaded from ELF file
 
+#define NZERO 256  // pre-zeroed pages to keep ready
+
 struct run {
   struct run *next;
 };
@@ -20,6 +25,12 @@ struct {
   struct spinlock lock;
   int use_lock;
   struct run *freelist;
+  struct run *zerolist;  // free pages zeroed but for the link
+  int nzero;
+  // Number of page table mappings (plus kernel users) of each
+  // physical page. Pages mapped shared into several address
+  // spaces are only freed when the last reference is dropped.
+  ushort ref[PHYSTOP >> PGSHIFT];
 } kmem;
 
 // Initialization happens in two phases.
@@ -47,25 +58,42 @@ freerange(void *vstart, void *vend)
 {
   char *p;
   p = (char*)PGROUNDUP((uint)vstart);
-  for(; p + PGSIZE <= (char*)vend; p += PGSIZE)
+  for(; p + PGSIZE <= (char*)vend; p += PGSIZE){
+    kmem.ref[V2P(p) >> PGSHIFT] = 1;
     kfree(p);
+  }
 }
 
 //PAGEBREAK: 21
-// Free the page of physical memory pointed at by v,
-// which normally should have been returned by a
+// Drop a reference to the page of physical memory pointed
+// at by v, which normally should have been returned by a
 // call to kalloc().  (The exception is when
 // initializing the allocator; see kinit above.)
+// The page goes back on the free list once its last
+// reference is gone.
 void
 kfree(char *v)
 {
   struct run *r;
+  int ref;
 
   if((uint)v % PGSIZE || v < end || V2P(v) >= PHYSTOP)
     panic("kfree");
 
+  if(kmem.use_lock)
+    acquire(&kmem.lock);
+  if(kmem.ref[V2P(v) >> PGSHIFT] < 1)
+    panic("kfree: ref");
+  ref = --kmem.ref[V2P(v) >> PGSHIFT];
+  if(kmem.use_lock)
+    release(&kmem.lock);
+  if(ref > 0)
+    return;
+
+#ifdef KMEMDEBUG
   // Fill with junk to catch dangling refs.
   memset(v, 1, PGSIZE);
+#endif
 
   if(kmem.use_lock)
     acquire(&kmem.lock);
@@ -89,8 +117,85 @@ kalloc(void)
   r = kmem.freelist;
   if(r)
     kmem.freelist = r->next;
+  else if((r = kmem.zerolist) != 0){
+    kmem.zerolist = r->next;
+    kmem.nzero--;
+  }
+  if(r)
+    kmem.ref[V2P(r) >> PGSHIFT] = 1;
+  if(kmem.use_lock)
+    release(&kmem.lock);
+  return (char*)r;
+}
+
+// Allocate a page of zeros, from the pre-zeroed pool if
+// there is one ready.
+char*
+kalloc_zeroed(void)
+{
+  struct run *r;
+
+  if(kmem.use_lock)
+    acquire(&kmem.lock);
+  if((r = kmem.zerolist) != 0){
+    kmem.zerolist = r->next;
+    kmem.nzero--;
+    kmem.ref[V2P(r) >> PGSHIFT] = 1;
+  }
   if(kmem.use_lock)
     release(&kmem.lock);
+  if(r){
+    r->next = 0;
+    return (char*)r;
+  }
+  if((r = (struct run*)kalloc()) != 0)
+    memset(r, 0, PGSIZE);
   return (char*)r;
 }
 
+// Zero one free page for the pool, if it is short.
+// Called by idle CPUs.  Returns 1 if it did any work.
+int
+kzero(void)
+{
+  struct run *r;
+
+  if(!kmem.use_lock || kmem.nzero >= NZERO || kmem.freelist == 0)
+    return 0;
+  acquire(&kmem.lock);
+  if(kmem.nzero >= NZERO || (r = kmem.freelist) == 0){
+    release(&kmem.lock);
+    return 0;
+  }
+  // Zero it off both lists, without the lock.
+  kmem.freelist = r->next;
+  release(&kmem.lock);
+
+  memset(r, 0, PGSIZE);
+
+  acquire(&kmem.lock);
+  r->next = kmem.zerolist;
+  kmem.zerolist = r;
+  kmem.nzero++;
+  release(&kmem.lock);
+  return 1;
+}
+
+// Add a reference to the page at v, so that it stays
+// allocated until a matching kfree().  Used to map the
+// same physical page into more than one page table.
+void
+kref(char *v)
+{
+  if((uint)v % PGSIZE || v < end || V2P(v) >= PHYSTOP)
+    panic("kref");
+
+  if(kmem.use_lock)
+    acquire(&kmem.lock);
+  if(kmem.ref[V2P(v) >> PGSHIFT] < 1 || kmem.ref[V2P(v) >> PGSHIFT] == 0xFFFF)
+    panic("kref: ref");
+  kmem.ref[V2P(v) >> PGSHIFT]++;
+  if(kmem.use_lock)
+    release(&kmem.lock);
+}
+
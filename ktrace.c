@@ -0,0 +1,151 @@
+// Kernel tracer.  Runs a command with kernel tracepoints on,
+// then prints the events from all CPUs in time order, with
+// times in microseconds since the first event.
+//
+// usage: ktrace [-e classes] command [args...]
+//   classes: comma-separated list of syscall, sched, disk,
+//   pgflt, commit, or all (the default)
+
+#include "types.h"
+#include "stat.h"
+#include "user.h"
+#include "fcntl.h"
+#include "x86.h"
+#include "memlayout.h"
+#include "date.h"
+#include "vdso.h"
+#include "syscall.h"
+#include "sysnames.h"
+#include "trace.h"
+#include "devrun.h"
+
+struct traceevent *ev;
+int nev, maxev;
+
+void
+add(void *e)
+{
+  struct traceevent *nv;
+
+  if(nev == maxev){
+    maxev = maxev ? 2*maxev : 256;
+    if((nv = malloc(maxev * sizeof(struct traceevent))) == 0){
+      printf(2, "ktrace: out of memory\n");
+      exit();
+    }
+    if(nev > 0){
+      memmove(nv, ev, nev * sizeof(struct traceevent));
+      free(ev);
+    }
+    ev = nv;
+  }
+  ev[nev++] = *(struct traceevent*)e;
+}
+
+int
+before(struct traceevent *x, struct traceevent *y)
+{
+  return x->tschi < y->tschi || (x->tschi == y->tschi && x->tsclo < y->tsclo);
+}
+
+char*
+sysname(uint num)
+{
+  if(num < sizeof(syscall_strings)/sizeof(syscall_strings[0]) &&
+     syscall_strings[num])
+    return syscall_strings[num];
+  return "?";
+}
+
+void
+show(struct traceevent *e, struct traceevent *first, uint tscperus)
+{
+  uint hi, lo;
+
+  hi = e->tschi - first->tschi - (e->tsclo < first->tsclo);
+  lo = e->tsclo - first->tsclo;
+  if(tscperus == 0 || hi >= tscperus)
+    hi = lo = 0;
+  printf(1, "%d cpu%d pid %d: ", div64(hi, lo, tscperus), e->cpu, e->pid);
+  switch(e->type){
+  case TR_LOST:
+    printf(1, "lost %d events\n", e->a);
+    break;
+  case TR_SYSCALL:
+    printf(1, "syscall %s\n", sysname(e->a));
+    break;
+  case TR_SYSRET:
+    printf(1, "sysret %s = %d\n", sysname(e->a), e->b);
+    break;
+  case TR_SWITCH:
+    printf(1, "switch to pid %d\n", e->a);
+    break;
+  case TR_DISK:
+    printf(1, "disk %s block %d\n", e->b ? "write" : "read", e->a);
+    break;
+  case TR_DISKDONE:
+    printf(1, "disk done block %d\n", e->a);
+    break;
+  case TR_PGFLT:
+    printf(1, "page fault at 0x%x eip 0x%x\n", e->a, e->b);
+    break;
+  case TR_COMMIT:
+    printf(1, "commit %d blocks\n", e->a);
+    break;
+  default:
+    printf(1, "event %d 0x%x 0x%x\n", e->type, e->a, e->b);
+  }
+}
+
+int
+main(int argc, char *argv[])
+{
+  struct traceevent t;
+  char classes[64], *p;
+  int fd, i, j, gap;
+
+  strcpy(classes, "all");
+  i = 1;
+  if(i + 1 < argc && strcmp(argv[i], "-e") == 0){
+    if(strlen(argv[i+1]) >= sizeof(classes)){
+      printf(2, "ktrace: too many classes\n");
+      exit();
+    }
+    strcpy(classes, argv[i+1]);
+    for(p = classes; *p; p++)
+      if(*p == ',')
+        *p = ' ';
+    i += 2;
+  }
+  if(i >= argc || argv[i][0] == '-'){
+    printf(2, "usage: ktrace [-e classes] command [args...]\n");
+    exit();
+  }
+
+  if((fd = open("trace", O_RDWR)) < 0){
+    printf(2, "ktrace: cannot open trace device\n");
+    exit();
+  }
+  if(devrun("ktrace", fd, classes, "off", argv + i,
+            sizeof(struct traceevent), add) < 0){
+    printf(2, "ktrace: cannot trace %s\n", classes);
+    exit();
+  }
+  close(fd);
+
+  // Shell sort by time-stamp; each CPU's events are in order
+  // already, but the CPUs' are interleaved.
+  for(gap = nev/2; gap > 0; gap /= 2){
+    for(i = gap; i < nev; i++){
+      t = ev[i];
+      for(j = i; j >= gap && before(&t, &ev[j-gap]); j -= gap)
+        ev[j] = ev[j-gap];
+      ev[j] = t;
+    }
+  }
+
+  for(i = 0; i < nev; i++)
+    show(&ev[i], &ev[0], ((struct vdso*)VDSO)->tscperus);
+  printf(1, "%d events\n", nev);
+  exit();
+}
@@ -42,6 +42,8 @@
 #define TCCR    (0x0390/4)   // Timer Current Count
 #define TDCR    (0x03E0/4)   // Timer Divide Configuration
 
+#define LAPICTICK 10000000  // timer count for one tick
+
 volatile uint *lapic;  // Initialized in mp.c
 
 static void
@@ -67,7 +69,7 @@ lapicinit(void)
   // TICR would be calibrated using an external time source.
   lapicw(TDCR, X1);
   lapicw(TIMER, PERIODIC | (T_IRQ0 + IRQ_TIMER));
-  lapicw(TICR, 10000000);
+  lapicw(TICR, LAPICTICK);
 
   // Disable logical interrupt lines.
   lapicw(LINT0, MASKED);
@@ -134,6 +136,14 @@ lapiceoi(void)
     lapicw(EOI, 0);
 }
 
+// Make this CPU's timer interrupt mult times a tick.
+void
+lapictimer(int mult)
+{
+  if(lapic)
+    lapicw(TICR, LAPICTICK / mult);
+}
+
 // Spin for a given number of microseconds.
 // On real hardware would want to tune this dynamically.
 void
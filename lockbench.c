@@ -0,0 +1,65 @@
+// Lock scaling benchmark.  Runs 1, 2, 4 and 8 processes that
+// each make uptime() system calls, which take tickslock, and
+// reports total calls per tick and how much the lock was
+// contended.  Run with CPUS=8 to see scaling.
+//
+// usage: lockbench [calls-per-process]
+
+#include "types.h"
+#include "stat.h"
+#include "user.h"
+#include "lockstat.h"
+
+struct lockstat ls[NLOCKCLASS];
+
+// Print the statistics for the lock named name.
+void
+report(char *name)
+{
+  int i, n;
+
+  n = lockstat(ls, NLOCKCLASS);
+  for(i = 0; i < n; i++){
+    if(strcmp(ls[i].name, name) == 0){
+      printf(1, "  %s: %d acquires, %d contended, %d kcycles spinning\n",
+             name, ls[i].nacquire, ls[i].ncontend,
+             ls[i].spinhi << 22 | ls[i].spinlo >> 10);
+      return;
+    }
+  }
+}
+
+int
+main(int argc, char *argv[])
+{
+  int i, k, np, calls, t0, t;
+
+  calls = 100000;
+  if(argc > 1)
+    calls = atoi(argv[1]);
+  if(calls <= 0){
+    printf(2, "usage: lockbench [calls-per-process]\n");
+    exit();
+  }
+
+  for(np = 1; np <= 8; np *= 2){
+    lockstat(0, 0);
+    t0 = uptime();
+    for(k = 0; k < np; k++){
+      if(fork() == 0){
+        for(i = 0; i < calls; i++)
+          uptime();
+        exit();
+      }
+    }
+    for(k = 0; k < np; k++)
+      wait();
+    t = uptime() - t0;
+    if(t == 0)
+      t = 1;
+    printf(1, "%d procs: %d calls in %d ticks, %d calls/tick\n",
+           np, np*calls, t, np*calls/t);
+    report("time");
+  }
+  exit();
+}
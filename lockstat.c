@@ -0,0 +1,57 @@
+// Print kernel lock statistics.  With a command, reset the
+// counters, run the command, and print what it caused.
+//
+// usage: lockstat [command [args...]]
+
+#include "types.h"
+#include "stat.h"
+#include "user.h"
+#include "lockstat.h"
+
+struct lockstat ls[NLOCKCLASS];
+
+int
+main(int argc, char *argv[])
+{
+  int i, j, n, pid;
+  struct lockstat t;
+
+  if(argc > 1){
+    lockstat(0, 0);
+    pid = fork();
+    if(pid < 0){
+      printf(2, "lockstat: fork failed\n");
+      exit();
+    }
+    if(pid == 0){
+      exec(argv[1], argv+1);
+      printf(2, "lockstat: exec %s failed\n", argv[1]);
+      exit();
+    }
+    wait();
+  }
+
+  if((n = lockstat(ls, NLOCKCLASS)) < 0){
+    printf(2, "lockstat: lockstat failed\n");
+    exit();
+  }
+  // Most spinning first.
+  for(i = 1; i < n; i++){
+    t = ls[i];
+    for(j = i; j > 0 && (ls[j-1].spinhi < t.spinhi ||
+        (ls[j-1].spinhi == t.spinhi && ls[j-1].spinlo < t.spinlo)); j--)
+      ls[j] = ls[j-1];
+    ls[j] = t;
+  }
+  printf(1, "name             acquire  contend  spin-kcycles\n");
+  for(i = 0; i < n; i++){
+    if(ls[i].nacquire == 0)
+      continue;
+    printf(1, "%s", ls[i].name);
+    for(j = strlen(ls[i].name); j < 16; j++)
+      printf(1, " ");
+    printf(1, " %d  %d  %d\n", ls[i].nacquire, ls[i].ncontend,
+           ls[i].spinhi << 22 | ls[i].spinlo >> 10);
+  }
+  exit();
+}
@@ -0,0 +1,11 @@
+// Lock contention statistics, as returned by lockstat().
+
+#define NLOCKCLASS 64  // lock names the kernel keeps statistics for
+
+struct lockstat {
+  char name[16];
+  uint nacquire;     // acquisitions
+  uint ncontend;     // acquisitions that had to wait
+  uint spinlo;       // TSC cycles spent waiting, low 32 bits
+  uint spinhi;       // and high 32 bits
+};
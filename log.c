@@ -5,6 +5,7 @@
 #include "sleeplock.h"
 #include "fs.h"
 #include "buf.h"
+#include "trace.h"
 
 // Simple logging that allows concurrent FS system calls.
 //
@@ -28,6 +29,22 @@
 //   block C
 //   ...
 // Log appends are synchronous.
+//
+// Commits are relaxed: end_op() commits only when the log is
+// too full for another system call, or when log_sync() has
+// asked for it (fsync, sync, O_SYNC).  Otherwise the syncer
+// thread commits every SYNCTICKS, so many small operations can
+// share one commit at the cost of losing up to that much work
+// in a crash.
+//
+// Installing a committed transaction's blocks at their home
+// locations (checkpointing) is not: commit() hands the list of
+// blocks to the flusher kernel thread and returns.  Until the
+// flusher is done the blocks stay pinned in the buffer cache,
+// and the next commit waits before it reuses the log.  The
+// flusher writes the committed copies from the log, not the
+// cached blocks, which a later transaction may already have
+// changed.
 
 // Contents of the header block, used for both the on-disk header block
 // and to keep track in memory of logged block# before commit.
@@ -40,23 +57,36 @@ struct logheader {
   int block[LOGSIZE];
 };
 
+#define SYNCTICKS 100  // most ticks a completed op waits for commit
+
 struct log {
   struct spinlock lock;
   int start;       // block number of first log block (from superblock)
   int size;        // number of logs in block (from superblock)
   int outstanding; // how many FS sys calls are executing.
   int committing;  // in commit(), please wait.
+  int syncwant;    // log_sync() is waiting; commit at next chance
+  int seq;         // number of the open transaction
+  int done;        // number of the last committed transaction
   int dev;         // device number
   struct logheader lh;
+  struct logheader ckpt;  // committed, waiting for the flusher
 };
 struct log log;
 
+// Bufs for writing committed blocks home; not in the cache.
+static struct buf shadow[NBATCH];
+
 static void recover_from_log(void);
 static void commit();
+static void flusher(void);
+static void syncer(void);
 
 void
 initlog(int dev)
 {
+  int i;
+
   if (sizeof(struct logheader) >= BSIZE)
     panic("initlog: too big logheader");
 
@@ -67,22 +97,34 @@ initlog(int dev)
   log.size = sb.nlog;
   log.dev = dev;
   recover_from_log();
+  for (i = 0; i < NBATCH; i++)
+    initsleeplock(&shadow[i].lock, "shadow");
+  log.seq = 1;
+  if (kthreadcreate(flusher, "flusher") < 0 ||
+     kthreadcreate(syncer, "syncer") < 0)
+    panic("initlog: kthreadcreate");
 }
 
 // Copy committed blocks from log to their home location
 // Same function as log_write but with src and dst flipped.
+// Writes go to the disk NBATCH at a time.  Used only by
+// recovery; see checkpoint() for the normal path.
 static void
 install_trans(void)
 {
-  int tail;
-
-  for (tail = 0; tail < log.lh.n; tail++) {
-    struct buf *lbuf = bread(log.dev, log.start+tail+1); // read log block
-    struct buf *dbuf = bread(log.dev, log.lh.block[tail]); // read dst
-    memmove(dbuf->data, lbuf->data, BSIZE);  // copy block to dst
-    bwrite(dbuf);  // write dst to disk
-    brelse(lbuf);
-    brelse(dbuf);
+  struct buf *dbuf[NBATCH];
+  int tail, i, n;
+
+  for (tail = 0; tail < log.lh.n; tail += n) {
+    for (n = 0; n < NBATCH && tail+n < log.lh.n; n++) {
+      struct buf *lbuf = bread(log.dev, log.start+tail+n+1); // read log block
+      dbuf[n] = bread(log.dev, log.lh.block[tail+n]); // read dst
+      memmove(dbuf[n]->data, lbuf->data, BSIZE);  // copy block to dst
+      brelse(lbuf);
+    }
+    bwritev(dbuf, n);  // write dsts to disk
+    for (i = 0; i < n; i++)
+      brelse(dbuf[i]);
   }
 }
 
@@ -100,18 +142,18 @@ read_head(void)
   brelse(buf);
 }
 
-// Write in-memory log header to disk.
+// Write log header lh to disk.
 // This is the true point at which the
 // current transaction commits.
 static void
-write_head(void)
+write_head(struct logheader *lh)
 {
   struct buf *buf = bread(log.dev, log.start);
   struct logheader *hb = (struct logheader *) (buf->data);
   int i;
-  hb->n = log.lh.n;
-  for (i = 0; i < log.lh.n; i++) {
-    hb->block[i] = log.lh.block[i];
+  hb->n = lh->n;
+  for (i = 0; i < lh->n; i++) {
+    hb->block[i] = lh->block[i];
   }
   bwrite(buf);
   brelse(buf);
@@ -123,7 +165,7 @@ recover_from_log(void)
   read_head();
   install_trans(); // if committed, copy from log to disk
   log.lh.n = 0;
-  write_head(); // clear the log
+  write_head(&log.lh); // clear the log
 }
 
 // called at the start of each FS system call.
@@ -153,8 +195,26 @@ begin_op(void)
   }
 }
 
+// Commit the open transaction and wake anyone waiting
+// for it.  Caller has set log.committing.
+static void
+docommit(void)
+{
+  // call commit w/o holding locks, since not allowed
+  // to sleep with locks (bget acquires buffer sleeplocks).
+  // Setting log.committing prevents other kernel threads
+  // from modifying the in-memory log.
+  commit();
+  acquire(&log.lock);  // Get lock to avoid missed wakeup
+  log.committing = 0;
+  log.done = log.seq++;
+  wakeup(&log);
+  release(&log.lock);
+}
+
 // called at the end of each FS system call.
-// commits if this was the last outstanding operation.
+// commits if this was the last outstanding operation
+// and the log is full or log_sync() is waiting.
 void
 end_op(void)
 {
@@ -164,44 +224,88 @@ end_op(void)
   log.outstanding -= 1;
   if(log.committing)
     panic("log.committing");
-  if(log.outstanding == 0){
+  if(log.outstanding == 0 &&
+     (log.syncwant || log.lh.n + MAXOPBLOCKS > LOGSIZE)){
     do_commit = 1;
     log.committing = 1;
+    log.syncwant = 0;
   } else {
     // begin_op() may be waiting for log space.
     wakeup(&log);
   }
   release(&log.lock);
 
-  if(do_commit){
-    // call commit w/o holding locks, since not allowed
-    // to sleep with locks (bget acquires buffer sleeplocks).
-    // Setting log.committing above prevents other kernel threads
-    // from modifying the in-memory log.
-    commit();
-    acquire(&log.lock);  // Get lock to avoid missed wakeup
-    log.committing = 0;
-    wakeup(&log);
+  if(do_commit)
+    docommit();
+}
+
+// Make every completed FS system call durable: commit the
+// open transaction, if it has anything in it, and wait until
+// it is in the on-disk log.  Call outside any transaction.
+void
+log_sync(void)
+{
+  int target;
+
+  acquire(&log.lock);
+  if(log.lh.n == 0 && !log.committing){
+    release(&log.lock);
+    return;
+  }
+  target = log.seq;
+  if(!log.committing && log.outstanding == 0){
+    log.committing = 1;
+    log.syncwant = 0;
     release(&log.lock);
+    docommit();
+    return;
+  }
+  // Let the last outstanding end_op() commit.
+  if(!log.committing)
+    log.syncwant = 1;
+  while(log.done < target)
+    sleep(&log, &log.lock);
+  release(&log.lock);
+}
+
+// The syncer kernel thread bounds how long a relaxed
+// commit can be put off.
+static void
+syncer(void)
+{
+  uint ticks0;
+
+  for(;;){
+    acquire(&tickslock);
+    ticks0 = ticks;
+    while(ticks - ticks0 < SYNCTICKS)
+      sleep(&ticks, &tickslock);
+    release(&tickslock);
+    log_sync();
   }
 }
 
-// Copy modified blocks from buffer cache to log on disk
+// Copy modified blocks from buffer cache to log on disk,
+// NBATCH at a time.
 static void
 write_log(void)
 {
-  int tail;
-
-  for (tail = 0; tail < log.lh.n; tail++) {
-    // Get pointers to buffer cache entries corresponding
-    // to the log block on disk we're about to modify
-    // and to the dirty block in the buffer cache
-    struct buf *to = bread(log.dev, log.start+tail+1); // log block
-    struct buf *from = bread(log.dev, log.lh.block[tail]); // cache block
-    memmove(to->data, from->data, BSIZE);
-    bwrite(to);  // write the cached log block to disk
-    brelse(from);
-    brelse(to);
+  struct buf *to[NBATCH];
+  int tail, i, n;
+
+  for (tail = 0; tail < log.lh.n; tail += n) {
+    for (n = 0; n < NBATCH && tail+n < log.lh.n; n++) {
+      // Get pointers to buffer cache entries corresponding
+      // to the log block on disk we're about to modify
+      // and to the dirty block in the buffer cache
+      to[n] = bread(log.dev, log.start+tail+n+1); // log block
+      struct buf *from = bread(log.dev, log.lh.block[tail+n]); // cache block
+      memmove(to[n]->data, from->data, BSIZE);
+      brelse(from);
+    }
+    bwritev(to, n);  // write the cached log blocks to disk
+    for (i = 0; i < n; i++)
+      brelse(to[i]);
   }
 }
 
@@ -209,13 +313,98 @@ static void
 commit()
 {
   if (log.lh.n > 0) {
+    // Wait for the flusher to free the log.
+    acquire(&log.lock);
+    while (log.ckpt.n > 0)
+      sleep(&log.ckpt.n, &log.lock);
+    release(&log.lock);
+
     write_log();     // Write modified blocks from cache to log
-    write_head();    // Write header to disk -- the real commit
-    install_trans(); // Now install writes to home locations
+    write_head(&log.lh);  // Write header to disk -- the real commit
+    TRACEPOINT(TR_COMMIT, log.lh.n, 0);
 
-    // Erase the transaction from the log
+    // Hand the transaction to the flusher to install.
+    acquire(&log.lock);
+    log.ckpt = log.lh;
     log.lh.n = 0;
-    write_head();
+    wakeup(log.ckpt.block);
+    release(&log.lock);
+  }
+}
+
+// Install the transaction in log.ckpt at its home locations,
+// in block order, NBATCH blocks at a time; then erase it from
+// the log and unpin its blocks.
+static void
+checkpoint(void)
+{
+  struct logheader empty;
+  struct buf *bs[NBATCH], *b;
+  int ord[LOGSIZE];
+  int i, j, k, n, blockno;
+
+  // Sort the log positions by home block number.
+  for (i = 0; i < log.ckpt.n; i++) {
+    for (j = i; j > 0 && log.ckpt.block[ord[j-1]] > log.ckpt.block[i]; j--)
+      ord[j] = ord[j-1];
+    ord[j] = i;
+  }
+
+  for (i = 0; i < log.ckpt.n; i += n) {
+    for (n = 0; n < NBATCH && i+n < log.ckpt.n; n++) {
+      k = ord[i+n];
+      b = bread(log.dev, log.start+k+1); // read log block
+      acquiresleep(&shadow[n].lock);
+      shadow[n].dev = log.dev;
+      shadow[n].blockno = log.ckpt.block[k];
+      shadow[n].flags = 0;
+      memmove(shadow[n].data, b->data, BSIZE);
+      brelse(b);
+      bs[n] = &shadow[n];
+    }
+    bwritev(bs, n);
+    for (j = 0; j < n; j++)
+      releasesleep(&shadow[j].lock);
+  }
+
+  // Erase the transaction from the log
+  empty.n = 0;
+  write_head(&empty);
+
+  // Unpin each block unless the open transaction has
+  // written it again.  Holding the buf keeps log_write
+  // from adding it meanwhile.
+  for (i = 0; i < log.ckpt.n; i++) {
+    blockno = log.ckpt.block[i];
+    b = bread(log.dev, blockno);
+    acquire(&log.lock);
+    for (j = 0; j < log.lh.n; j++)
+      if (log.lh.block[j] == blockno)
+        break;
+    if (j == log.lh.n)
+      b->flags &= ~B_DIRTY;
+    release(&log.lock);
+    brelse(b);
+  }
+}
+
+// The flusher kernel thread checkpoints each transaction
+// after commit() hands it over.
+static void
+flusher(void)
+{
+  for (;;) {
+    acquire(&log.lock);
+    while (log.ckpt.n == 0)
+      sleep(log.ckpt.block, &log.lock);
+    release(&log.lock);
+
+    checkpoint();
+
+    acquire(&log.lock);
+    log.ckpt.n = 0;
+    wakeup(&log.ckpt.n);
+    release(&log.lock);
   }
 }
 
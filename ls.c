@@ -2,6 +2,8 @@
 #include "stat.h"
 #include "user.h"
 #include "fs.h"
+#include "fcntl.h"
+#include "ring.h"
 
 char*
 fmtname(char *path)
@@ -22,49 +24,108 @@ fmtname(char *path)
   return buf;
 }
 
+// ls batches its system calls with ring_enter(): each
+// directory block is read at once, and its entries are
+// stat()ed NBATCH at a time, with one open/fstat/close
+// batch each.
+
+#define NBATCH  (RINGSIZE / 3)
+#define NDIRENT (512 / sizeof(struct dirent))
+#define MAXPATH 512
+#define NODATA  0xffffffff
+
+struct ring ring;
+
+// Open and fstat path in one batch, leaving it open.
+// Returns the fd, or -1.
+int
+openstat(char *path, struct stat *st)
+{
+  struct cqe c;
+  int fd, ok;
+
+  ringput(&ring, RING_OPEN, 0, 0, path, O_RDONLY, 0);
+  ringput(&ring, RING_FSTAT, RING_LINK, 0, st, 0, 1);
+  ring_enter(&ring);
+  fd = -1;
+  ok = 0;
+  while(ringget(&ring, &c)){
+    if(c.data == 0)
+      fd = c.res;
+    else
+      ok = c.res == 0;
+  }
+  if(fd >= 0 && !ok){
+    close(fd);
+    return -1;
+  }
+  return fd;
+}
+
+// Stat and print the n entries in de of directory path.
+void
+lsents(char *path, struct dirent *de, int n)
+{
+  static char names[NBATCH][MAXPATH];
+  static struct stat st[NBATCH];
+  int i, j, k, len, ok[NBATCH];
+  struct cqe c;
+
+  len = strlen(path);
+  i = 0;
+  while(i < n){
+    for(k = 0; k < NBATCH && i < n; i++){
+      if(de[i].inum == 0)
+        continue;
+      strcpy(names[k], path);
+      names[k][len] = '/';
+      memmove(names[k]+len+1, de[i].name, DIRSIZ);
+      names[k][len+1+DIRSIZ] = 0;
+      ok[k] = 0;
+      ringput(&ring, RING_OPEN, 0, 0, names[k], O_RDONLY, NODATA);
+      ringput(&ring, RING_FSTAT, RING_LINK, 0, &st[k], 0, k);
+      ringput(&ring, RING_CLOSE, RING_LINK, 0, 0, 0, NODATA);
+      k++;
+    }
+    if(k == 0)
+      break;
+    ring_enter(&ring);
+    while(ringget(&ring, &c))
+      if(c.data != NODATA && c.res == 0)
+        ok[c.data] = 1;
+    for(j = 0; j < k; j++){
+      if(ok[j])
+        printf(1, "%s %d %d %d\n", fmtname(names[j]), st[j].type, st[j].ino, st[j].size);
+      else
+        printf(1, "ls: cannot stat %s\n", names[j]);
+    }
+  }
+}
+
 void
 ls(char *path)
 {
-  char buf[512], *p;
-  int fd;
-  struct dirent de;
+  int fd, n;
+  struct dirent de[NDIRENT];
   struct stat st;
 
-  if((fd = open(path, 0)) < 0){
+  if((fd = openstat(path, &st)) < 0){
     printf(2, "ls: cannot open %s\n", path);
     return;
   }
 
-  if(fstat(fd, &st) < 0){
-    printf(2, "ls: cannot stat %s\n", path);
-    close(fd);
-    return;
-  }
-
   switch(st.type){
   case T_FILE:
     printf(1, "%s %d %d %d\n", fmtname(path), st.type, st.ino, st.size);
     break;
 
   case T_DIR:
-    if(strlen(path) + 1 + DIRSIZ + 1 > sizeof buf){
+    if(strlen(path) + 1 + DIRSIZ + 1 > MAXPATH){
       printf(1, "ls: path too long\n");
       break;
     }
-    strcpy(buf, path);
-    p = buf+strlen(buf);
-    *p++ = '/';
-    while(read(fd, &de, sizeof(de)) == sizeof(de)){
-      if(de.inum == 0)
-        continue;
-      memmove(p, de.name, DIRSIZ);
-      p[DIRSIZ] = 0;
-      if(stat(buf, &st) < 0){
-        printf(1, "ls: cannot stat %s\n", buf);
-        continue;
-      }
-      printf(1, "%s %d %d %d\n", fmtname(buf), st.type, st.ino, st.size);
-    }
+    while((n = read(fd, de, sizeof(de))) > 0)
+      lsents(path, de, n / sizeof(struct dirent));
     break;
   }
   close(fd);
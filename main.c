@@ -26,11 +26,17 @@ main(void)
   picinit();       // another interrupt controller
   ioapicinit();    // another interrupt controller
   consoleinit();   // console hardware
+  profinit();      // kernel profiler device
+  traceinit();     // kernel trace device
   uartinit();      // serial port
   pinit();         // process table
   tvinit();        // trap vectors
+  vdsoinit();      // page of kernel data for user space
   binit();         // buffer cache
   fileinit();      // file table
+  fdinit();        // file descriptor tables
+  pipeinit();      // pipe buffers
+  seminit();       // eventfd counters
   ideinit();       // disk
   if(!ismp)
     timerinit();   // uniprocessor timer
@@ -0,0 +1,79 @@
+// Memory copy and zero benchmark.  Times user-space memset and
+// memmove on 4 KB pages, then the kernel's: zeroing pages for
+// lazily allocated heap, and copying them in fork().
+//
+// usage: membench [pages]
+
+#include "types.h"
+#include "stat.h"
+#include "user.h"
+
+#define PGSIZE 4096
+#define HEAP   (1024*1024)
+
+char src[PGSIZE], dst[PGSIZE];
+
+// Print the rate for n pages in t ticks.
+void
+rate(char *what, int n, int t)
+{
+  if(t == 0){
+    printf(1, "%s: %d pages in 0 ticks; use more pages\n", what, n);
+    return;
+  }
+  printf(1, "%s: %d pages in %d ticks: %d KB/s\n",
+         what, n, t, n / t * 400 + n % t * 400 / t);
+}
+
+int
+main(int argc, char *argv[])
+{
+  int i, j, n, t0, pid;
+  char *heap;
+
+  n = 50000;
+  if(argc > 1)
+    n = atoi(argv[1]);
+  if(n <= 0){
+    printf(2, "usage: membench [pages]\n");
+    exit();
+  }
+
+  t0 = uptime();
+  for(i = 0; i < n; i++)
+    memset(dst, i, PGSIZE);
+  rate("user memset", n, uptime() - t0);
+
+  t0 = uptime();
+  for(i = 0; i < n; i++)
+    memmove(dst, src, PGSIZE);
+  rate("user memmove", n, uptime() - t0);
+
+  // Each first touch of a new heap page makes the kernel
+  // allocate and zero it.
+  t0 = uptime();
+  for(i = 0; i < n; i += HEAP/PGSIZE){
+    heap = sbrk(HEAP);
+    for(j = 0; j < HEAP; j += PGSIZE)
+      heap[j] = 1;
+    sbrk(-HEAP);
+  }
+  rate("kernel zero", i, uptime() - t0);
+
+  // fork() copies every page of the heap.
+  heap = sbrk(HEAP);
+  for(j = 0; j < HEAP; j += PGSIZE)
+    heap[j] = 1;
+  t0 = uptime();
+  for(i = 0; i < n; i += HEAP/PGSIZE){
+    if((pid = fork()) < 0){
+      printf(2, "membench: fork failed\n");
+      exit();
+    }
+    if(pid == 0)
+      exit();
+    wait();
+  }
+  rate("kernel copy", i, uptime() - t0);
+  exit();
+}
@@ -9,6 +9,7 @@
 #include "x86.h"
 #include "traps.h"
 #include "spinlock.h"
+#include "sleeplock.h"
 #include "fs.h"
 #include "buf.h"
 
@@ -57,3 +58,12 @@ iderw(struct buf *b)
     memmove(b->data, p, BSIZE);
   b->flags |= B_VALID;
 }
+
+void
+iderwv(struct buf **bs, int n)
+{
+  int i;
+
+  for(i = 0; i < n; i++)
+    iderw(bs[i]);
+}
@@ -8,6 +8,16 @@
 #define KERNBASE 0x80000000         // First kernel virtual address
 #define KERNLINK (KERNBASE+EXTMEM)  // Address where kernel is linked
 
+// Read-only pages the kernel keeps up to date for user code
+// (see vdso.h); VDSO is shared by all, VPROC is per process.
+#define VDSO     (KERNBASE-0x1000)
+#define VPROC    (KERNBASE-0x2000)
+
+// Shared memory segment (see shmbrk in sysproc.c). Pages mapped
+// here are shared with, not copied into, children on fork.
+#define SHMBASE  0x60000000         // First shared memory address
+#define SHMTOP   VPROC              // Shared memory ends below here
+
 #define V2P(a) (((uint) (a)) - KERNBASE)
 #define P2V(a) (((void *) (a)) + KERNBASE)
 
@@ -90,7 +90,7 @@ main(int argc, char *argv[])
     exit(1);
   }
 
-  // 1 fs block = 1 disk sector
+  // 1 fs block = BSIZE/512 disk sectors
   nmeta = 2 + nlog + ninodeblocks + nbitmap;
   nblocks = FSSIZE - nmeta;
 
@@ -260,7 +260,7 @@ iappend(uint inum, void *xp, int n)
   struct dinode din;
   char buf[BSIZE];
   uint indirect[NINDIRECT];
-  uint x;
+  uint x, y;
 
   rinode(inum, &din);
   off = xint(din.size);
@@ -273,6 +273,24 @@ iappend(uint inum, void *xp, int n)
         din.addrs[fbn] = xint(freeblock++);
       }
       x = xint(din.addrs[fbn]);
+    } else if(fbn >= NDIRECT + NINDIRECT){
+      // doubly-indirect: addrs[NDIRECT+1] -> indirect -> data
+      if(xint(din.addrs[NDIRECT+1]) == 0){
+        din.addrs[NDIRECT+1] = xint(freeblock++);
+      }
+      rsect(xint(din.addrs[NDIRECT+1]), (char*)indirect);
+      y = (fbn - NDIRECT - NINDIRECT) / NINDIRECT;
+      if(indirect[y] == 0){
+        indirect[y] = xint(freeblock++);
+        wsect(xint(din.addrs[NDIRECT+1]), (char*)indirect);
+      }
+      y = xint(indirect[y]);
+      rsect(y, (char*)indirect);
+      if(indirect[(fbn - NDIRECT) % NINDIRECT] == 0){
+        indirect[(fbn - NDIRECT) % NINDIRECT] = xint(freeblock++);
+        wsect(y, (char*)indirect);
+      }
+      x = xint(indirect[(fbn - NDIRECT) % NINDIRECT]);
     } else {
       if(xint(din.addrs[NDIRECT]) == 0){
         din.addrs[NDIRECT] = xint(freeblock++);
@@ -40,13 +40,20 @@
 #define CR4_PSE         0x00000010      // Page size extension
 
 // various segment selectors.
+// sysenter/sysexit require KDATA, UCODE and UDATA to
+// follow KCODE in that order.
 #define SEG_KCODE 1  // kernel code
 #define SEG_KDATA 2  // kernel data+stack
-#define SEG_KCPU  3  // kernel per-cpu data
-#define SEG_UCODE 4  // user code
-#define SEG_UDATA 5  // user data+stack
+#define SEG_UCODE 3  // user code
+#define SEG_UDATA 4  // user data+stack
+#define SEG_KCPU  5  // kernel per-cpu data
 #define SEG_TSS   6  // this process's task state
 
+// Model-specific registers for sysenter.
+#define MSR_SYSENTER_CS   0x174
+#define MSR_SYSENTER_ESP  0x175
+#define MSR_SYSENTER_EIP  0x176
+
 // cpu->gdt[NSEGS] holds the above segments.
 #define NSEGS     7
 
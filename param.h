@@ -1,13 +1,16 @@
-#define NPROC        64  // maximum number of processes
+#ifndef NPROC
+#define NPROC       512  // maximum number of processes (make NPROC=n);
+                         // keep it below 1000 for forktest
+#endif
 #define KSTACKSIZE 4096  // size of per-process kernel stack
 #define NCPU          8  // maximum number of CPUs
-#define NOFILE       16  // open files per process
-#define NFILE       100  // open files per system
-#define NINODE       50  // maximum number of active i-nodes
+#define NOFILE     4096  // open files per process
+#define NFDCHUNK     64  // fd table entries allocated at a time
 #define NDEV         10  // maximum major device number
 #define ROOTDEV       1  // device number of file system root disk
 #define MAXARG       32  // max exec arguments
 #define MAXOPBLOCKS  10  // max # of blocks any FS op writes
 #define LOGSIZE      (MAXOPBLOCKS*3)  // max data blocks in on-disk log
-#define NBUF         (MAXOPBLOCKS*3)  // size of disk block cache
-#define FSSIZE       20000  // size of file system in blocks
+#define NBATCH        8  // most log blocks queued to the disk at once
+#define NBUF         (MAXOPBLOCKS*8)  // size of disk block cache
+#define FSSIZE       5000  // size of file system in blocks
@@ -0,0 +1,81 @@
+// PCI bus scanning through configuration mechanism #1:
+// write the address of a configuration register to
+// CONFADDR and read or write its value at CONFDATA.
+
+#include "types.h"
+#include "defs.h"
+#include "x86.h"
+#include "pci.h"
+
+#define CONFADDR  0xcf8
+#define CONFDATA  0xcfc
+
+static uint
+confaddr(uint bus, uint dev, uint func, uint off)
+{
+  return 0x80000000 | bus<<16 | dev<<11 | func<<8 | (off & 0xfc);
+}
+
+uint
+pciread(struct pcidev *d, uint off)
+{
+  outl(CONFADDR, confaddr(d->bus, d->dev, d->func, off));
+  return inl(CONFDATA);
+}
+
+void
+pciwrite(struct pcidev *d, uint off, uint v)
+{
+  outl(CONFADDR, confaddr(d->bus, d->dev, d->func, off));
+  outl(CONFDATA, v);
+}
+
+// Fill in d from the configuration space of the function
+// at d->bus, d->dev, d->func.  Return 0 if there is none.
+static int
+pciprobe(struct pcidev *d)
+{
+  uint id, class, i;
+
+  id = pciread(d, PCI_ID);
+  if((id & 0xffff) == 0xffff)
+    return 0;
+  d->vendor = id & 0xffff;
+  d->device = id >> 16;
+  class = pciread(d, PCI_CLASS);
+  d->class = class >> 24;
+  d->subclass = class >> 16;
+  d->progif = class >> 8;
+  d->irq = pciread(d, PCI_INTR);
+  for(i = 0; i < 6; i++)
+    d->bar[i] = pciread(d, PCI_BAR0 + 4*i);
+  return 1;
+}
+
+// Find the first PCI function that matches vendor, device,
+// class and subclass, any of which may be PCI_ANY, and
+// fill in d.  Return 0 if found, -1 if not.
+int
+pcifind(struct pcidev *d, int vendor, int device, int class, int subclass)
+{
+  uint nfunc;
+
+  for(d->bus = 0; d->bus < 256; d->bus++){
+    for(d->dev = 0; d->dev < 32; d->dev++){
+      nfunc = 1;
+      for(d->func = 0; d->func < nfunc; d->func++){
+        if(!pciprobe(d))
+          continue;
+        // Bit 7 of the header type marks a multi-function device.
+        if(d->func == 0 && (pciread(d, PCI_HEADER) & 0x800000))
+          nfunc = 8;
+        if((vendor == PCI_ANY || d->vendor == vendor) &&
+           (device == PCI_ANY || d->device == device) &&
+           (class == PCI_ANY || d->class == class) &&
+           (subclass == PCI_ANY || d->subclass == subclass))
+          return 0;
+      }
+    }
+  }
+  return -1;
+}
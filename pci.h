@@ -0,0 +1,31 @@
+// PCI configuration space.
+
+#define PCI_ID        0x00  // vendor id, device id
+#define PCI_COMMAND   0x04  // command, status
+#define PCI_CLASS     0x08  // revision, prog if, subclass, class
+#define PCI_HEADER    0x0c  // header type in byte 2
+#define PCI_BAR0      0x10  // base address registers 0-5
+#define PCI_INTR      0x3c  // interrupt line in byte 0
+
+#define PCI_CMD_IO      0x1  // respond to I/O space accesses
+#define PCI_CMD_MEM     0x2  // respond to memory space accesses
+#define PCI_CMD_MASTER  0x4  // device may act as a bus master
+
+#define PCI_CLASS_STORAGE  0x01
+#define PCI_SUBCLASS_IDE   0x01
+
+#define PCI_ANY  -1   // wildcard for pcifind
+
+// A function found by pcifind.
+struct pcidev {
+  uint bus;
+  uint dev;
+  uint func;
+  ushort vendor;
+  ushort device;
+  uchar class;
+  uchar subclass;
+  uchar progif;
+  uchar irq;
+  uint bar[6];
+};
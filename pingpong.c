@@ -0,0 +1,89 @@
+// Ping-pong latency: two processes hand a token back and
+// forth, first through a pair of pipes, then through a pair
+// of eventfd semaphores.
+//
+// usage: pingpong [rounds]
+
+#include "types.h"
+#include "stat.h"
+#include "user.h"
+#include "fcntl.h"
+
+// Send the token to one fd and wait for it on the other.
+// Pipes move a byte; semaphores move a count of 1.
+int
+bounce(int tx, int rx, int n, int sz)
+{
+  int v;
+
+  v = 1;
+  while(n-- > 0){
+    if(write(tx, &v, sz) != sz || read(rx, &v, sz) != sz)
+      return -1;
+  }
+  return 0;
+}
+
+// Child echoes the token; parent starts it and times rounds.
+void
+run(char *name, int ping[2], int pong[2], int n, int sz)
+{
+  int pid, t0, t;
+
+  pid = fork();
+  if(pid < 0){
+    printf(1, "pingpong: fork failed\n");
+    exit();
+  }
+  if(pid == 0){
+    int v;
+    while(read(ping[0], &v, sz) == sz)
+      if(write(pong[1], &v, sz) != sz)
+        break;
+    exit();
+  }
+  t0 = uptime();
+  if(bounce(ping[1], pong[0], n, sz) < 0)
+    printf(1, "pingpong: %s failed\n", name);
+  t = uptime() - t0;
+  kill(pid);
+  wait();
+  // One tick is 10ms.
+  printf(1, "%s: %d rounds in %d ticks, %d us/round\n",
+         name, n, t, t * 10000 / n);
+}
+
+int
+main(int argc, char *argv[])
+{
+  int n, ping[2], pong[2];
+
+  n = 10000;
+  if(argc > 1)
+    n = atoi(argv[1]);
+  if(n <= 0){
+    printf(2, "usage: pingpong [rounds]\n");
+    exit();
+  }
+
+  if(pipe(ping) < 0 || pipe(pong) < 0){
+    printf(1, "pingpong: pipe failed\n");
+    exit();
+  }
+  run("pipe", ping, pong, n, 1);
+  close(ping[0]); close(ping[1]);
+  close(pong[0]); close(pong[1]);
+
+  // The same fd serves as both ends of a semaphore.
+  ping[0] = ping[1] = eventfd(0, EFD_SEMAPHORE);
+  pong[0] = pong[1] = eventfd(0, EFD_SEMAPHORE);
+  if(ping[0] < 0 || pong[0] < 0){
+    printf(1, "pingpong: eventfd failed\n");
+    exit();
+  }
+  run("eventfd", ping, pong, n, sizeof(int));
+  close(ping[0]);
+  close(pong[0]);
+
+  exit();
+}
@@ -6,6 +6,7 @@
 #include "x86.h"
 #include "proc.h"
 #include "spinlock.h"
+#include "trace.h"
 
 
 /*
@@ -39,11 +40,29 @@ Terms
   user thread: thread running in user mode
 */
 
+#define NPIDHASH 64
+
+// Procs are allocated from a slab cache and kept on a list
+// while they exist, up to NPROC of them.  They are also
+// hashed by pid, and linked to their parent's children.
 struct {
   struct spinlock lock;
-  struct proc proc[NPROC];
+  struct kmem_cache *cache;
+  struct proc *list;
+  int nproc;
+  struct proc *pidhash[NPIDHASH];
 } ptable;
 
+// The address space of a process and the threads it clone()s,
+// which share one page table.  The last of them to be freed
+// frees the page table.
+struct vmspace {
+  struct spinlock lock;  // serializes changes to the page table
+  int ref;               // procs using it; guarded by ptable.lock
+};
+
+static struct kmem_cache *vmcache;
+
 static struct proc *initproc;
 
 int nextpid = 1;
@@ -51,44 +70,108 @@ extern void forkret(void);
 extern void trapret(void);
 
 static void wakeup1(void *chan);
+static void setparent(struct proc *p, struct proc *parent);
+static int wakeupn1(void *chan, int n);
+static void freeproc(struct proc *p);
 
 void
 pinit(void)
 {
   initlock(&ptable.lock, "ptable");
+  ptable.cache = kmem_cache_create("proc", sizeof(struct proc));
+  vmcache = kmem_cache_create("vmspace", sizeof(struct vmspace));
+}
+
+// Allocate an address space with one reference, for
+// a page table not yet shared.  Returns 0 if out of memory.
+struct vmspace*
+vmspacealloc(void)
+{
+  struct vmspace *vm;
+
+  if((vm = kmem_cache_alloc(vmcache)) == 0)
+    return 0;
+  initlock(&vm->lock, "vmspace");
+  vm->ref = 1;
+  return vm;
+}
+
+// Free an address space that was never used.
+void
+vmspacefree(struct vmspace *vm)
+{
+  kmem_cache_free(vmcache, vm);
+}
+
+// Lock the current process's address space, so that its
+// threads take turns to map pages and change their size.
+void
+vmlock(void)
+{
+  acquire(&proc->vm->lock);
+}
+
+void
+vmunlock(void)
+{
+  release(&proc->vm->lock);
+}
+
+// Do other threads use the current process's page table?
+// Freeing its pages would then need their CPUs' TLBs flushed
+// too, so callers refuse to.  Caller holds vmlock(), which
+// keeps clone() from adding a thread meanwhile.
+int
+vmshared(void)
+{
+  return proc->vm->ref > 1;
 }
 
 //PAGEBREAK: 32
-// Look in the process table for an UNUSED proc.
-// If found, change state to EMBRYO and initialize
-// state required to run in the kernel.
-// Otherwise return 0.
+// Allocate a proc and add it to the process table
+// in state EMBRYO, with the state required to run
+// in the kernel initialized.
+// Return 0 if out of memory or procs.
 static struct proc*
 allocproc(void)
 {
   struct proc *p;
   char *sp;
 
-  acquire(&ptable.lock);
-
-  for(p = ptable.proc; p < &ptable.proc[NPROC]; p++)
-    if(p->state == UNUSED)
-      goto found;
+  if((p = kmem_cache_alloc(ptable.cache)) == 0)
+    return 0;
+  memset(p, 0, sizeof(*p));
 
-  release(&ptable.lock);
-  return 0;
+  // Allocate kernel stack.
+  if((p->kstack = kalloc()) == 0){
+    kmem_cache_free(ptable.cache, p);
+    return 0;
+  }
+  if((p->vm = vmspacealloc()) == 0){
+    kfree(p->kstack);
+    kmem_cache_free(ptable.cache, p);
+    return 0;
+  }
 
-found:
+  acquire(&ptable.lock);
+  if(ptable.nproc >= NPROC){
+    release(&ptable.lock);
+    vmspacefree(p->vm);
+    kfree(p->kstack);
+    kmem_cache_free(ptable.cache, p);
+    return 0;
+  }
+  ptable.nproc++;
   p->state = EMBRYO;
   p->pid = nextpid++;
-
+  p->next = ptable.list;
+  if(ptable.list)
+    ptable.list->prev = p;
+  ptable.list = p;
+  p->hnext = ptable.pidhash[p->pid % NPIDHASH];
+  ptable.pidhash[p->pid % NPIDHASH] = p;
   release(&ptable.lock);
 
-  // Allocate kernel stack.
-  if((p->kstack = kalloc()) == 0){
-    p->state = UNUSED;
-    return 0;
-  }
   sp = p->kstack + KSTACKSIZE;
 
   // Leave room for trap frame.
@@ -122,7 +205,10 @@ userinit(void)
   if((p->pgdir = setupkvm()) == 0)
     panic("userinit: out of memory?");
   inituvm(p->pgdir, _binary_initcode_start, (int)_binary_initcode_size);
+  if(vdsomap(p->pgdir, p->pid) < 0)
+    panic("userinit: out of memory?");
   p->sz = PGSIZE;
+  p->shmsz = 0;
   memset(p->tf, 0, sizeof(*p->tf));
   p->tf->cs = (SEG_UCODE << 3) | DPL_USER;
   p->tf->ds = (SEG_UDATA << 3) | DPL_USER;
@@ -146,6 +232,46 @@ userinit(void)
   release(&ptable.lock);
 }
 
+// A kernel thread starts here, like forkret, and returns
+// into its function (see kthreadcreate).
+static void
+kthreadstart(void)
+{
+  // Still holding ptable.lock from scheduler.
+  release(&ptable.lock);
+}
+
+// Start a kernel thread running fn, which must not return.
+// It has no user memory and only the kernel's mappings.
+// Return its pid, or -1 on failure.
+int
+kthreadcreate(void (*fn)(void), char *name)
+{
+  struct proc *p;
+
+  if((p = allocproc()) == 0)
+    return -1;
+  if((p->pgdir = setupkvm()) == 0){
+    acquire(&ptable.lock);
+    freeproc(p);
+    release(&ptable.lock);
+    return -1;
+  }
+  p->sz = 0;
+  p->shmsz = 0;
+  p->parent = 0;
+  p->cwd = 0;
+  // Return from kthreadstart into fn instead of trapret.
+  *(uint*)(p->context + 1) = (uint)fn;
+  p->context->eip = (uint)kthreadstart;
+  safestrcpy(p->name, name, sizeof(p->name));
+
+  acquire(&ptable.lock);
+  p->state = RUNNABLE;
+  release(&ptable.lock);
+  return p->pid;
+}
+
 // Grow current process's memory by n bytes.
 // Return 0 on success, -1 on failure.
 int
@@ -153,15 +279,22 @@ growproc(int n)
 {
   uint sz;
 
+  vmlock();
   sz = proc->sz;
   if(n > 0){
-    if((sz = allocuvm(proc->pgdir, sz, sz + n)) == 0)
+    if((sz = allocuvm(proc->pgdir, sz, sz + n)) == 0){
+      vmunlock();
       return -1;
+    }
   } else if(n < 0){
-    if((sz = deallocuvm(proc->pgdir, sz, sz + n)) == 0)
+    if(vmshared() || (sz = deallocuvm(proc->pgdir, sz, sz + n)) == 0){
+      vmunlock();
       return -1;
+    }
   }
   proc->sz = sz;
+  threadsync();
+  vmunlock();
   switchuvm(proc);
   return 0;
 }
@@ -172,7 +305,7 @@ growproc(int n)
 int
 fork(void)
 {
-  int i, pid;
+  int pid;
   struct proc *np;
 
   // Allocate process.
@@ -180,23 +313,98 @@ fork(void)
     return -1;
   }
 
-  // Copy process state from p.
-  if((np->pgdir = copyuvm(proc->pgdir, proc->sz)) == 0){
-    kfree(np->kstack);
-    np->kstack = 0;
-    np->state = UNUSED;
+  // Copy process state from p, while its threads leave
+  // the page table alone.
+  vmlock();
+  np->pgdir = copyuvm(proc->pgdir, proc->sz, proc->shmsz);
+  vmunlock();
+  if(np->pgdir == 0 || vdsomap(np->pgdir, np->pid) < 0){
+    if(np->pgdir)
+      freevm(np->pgdir);
+    np->pgdir = 0;
+    acquire(&ptable.lock);
+    freeproc(np);
+    release(&ptable.lock);
     return -1;
   }
   np->sz = proc->sz;
-  np->parent = proc;
+  np->shmsz = proc->shmsz;
   *np->tf = *proc->tf;
 
   // Clear %eax so that fork returns 0 in the child.
   np->tf->eax = 0;
 
-  for(i = 0; i < NOFILE; i++)
-    if(proc->ofile[i])
-      np->ofile[i] = filedup(proc->ofile[i]);
+  if(fdcopy(np, proc) < 0){
+    fdcloseall(np);
+    freevm(np->pgdir);
+    np->pgdir = 0;
+    acquire(&ptable.lock);
+    freeproc(np);
+    release(&ptable.lock);
+    return -1;
+  }
+  np->cwd = idup(proc->cwd);
+
+  safestrcpy(np->name, proc->name, sizeof(proc->name));
+
+  pid = np->pid;
+
+  acquire(&ptable.lock);
+
+  setparent(np, proc);
+  np->state = RUNNABLE;
+
+  release(&ptable.lock);
+
+  return pid;
+}
+
+// Create a new thread of the current process, running fn(arg)
+// on the PGSIZE-byte user stack at stack. The thread shares the
+// page table and starts with duplicates of the open files and
+// cwd, and is otherwise scheduled like any process. fn must not
+// return; threads leave with exit(). Returns the thread's pid.
+int
+clone(void (*fn)(void*), void *arg, void *stack)
+{
+  int pid;
+  struct proc *np;
+  uint sp;
+
+  if((np = allocproc()) == 0)
+    return -1;
+
+  vmlock();
+  acquire(&ptable.lock);
+  vmspacefree(np->vm);
+  np->vm = proc->vm;
+  np->vm->ref++;
+  release(&ptable.lock);
+  vmunlock();
+  np->pgdir = proc->pgdir;
+  np->sz = proc->sz;
+  np->shmsz = proc->shmsz;
+  np->ustack = stack;
+  *np->tf = *proc->tf;
+
+  // Same address space, so write the thread's initial stack
+  // directly: arg, and a fake return PC above it.
+  sp = (uint)stack + PGSIZE;
+  sp -= 4;
+  *(uint*)sp = (uint)arg;
+  sp -= 4;
+  *(uint*)sp = 0xffffffff;
+  np->tf->esp = sp;
+  np->tf->eip = (uint)fn;
+  np->tf->eax = 0;
+
+  if(fdcopy(np, proc) < 0){
+    fdcloseall(np);
+    acquire(&ptable.lock);
+    freeproc(np);
+    release(&ptable.lock);
+    return -1;
+  }
   np->cwd = idup(proc->cwd);
 
   safestrcpy(np->name, proc->name, sizeof(proc->name));
@@ -205,6 +413,7 @@ fork(void)
 
   acquire(&ptable.lock);
 
+  setparent(np, proc);
   np->state = RUNNABLE;
 
   release(&ptable.lock);
@@ -212,11 +421,101 @@ fork(void)
   return pid;
 }
 
+// Wait for a thread created by this thread to exit, clean
+// it up, and return its pid and (in *stack) the user stack
+// that was passed to clone().
+// Return -1 if this thread has no child threads.
+int
+join(void **stack)
+{
+  struct proc *p;
+  int havekids, pid;
+  void *ustack;
+
+  acquire(&ptable.lock);
+  for(;;){
+    havekids = 0;
+    for(p = proc->children; p; p = p->sibling){
+      if(p->pgdir != proc->pgdir)
+        continue;
+      havekids = 1;
+      if(p->state == ZOMBIE){
+        pid = p->pid;
+        ustack = p->ustack;
+        freeproc(p);
+        release(&ptable.lock);
+        *stack = ustack;
+        return pid;
+      }
+    }
+
+    if(!havekids || proc->killed){
+      release(&ptable.lock);
+      return -1;
+    }
+
+    sleep(proc, &ptable.lock);  //DOC: wait-sleep
+  }
+}
+
+// Switch the current process to the new page table pgdir and
+// address space vm, which exec has built, and drop its reference
+// to the old ones.  Threads still running in the old page table
+// are killed, and whichever of them is reaped last frees it.
+void
+switchvm(pde_t *pgdir, struct vmspace *vm)
+{
+  struct vmspace *oldvm;
+  pde_t *oldpgdir;
+  struct proc *p;
+
+  oldpgdir = proc->pgdir;
+  oldvm = proc->vm;
+  acquire(&ptable.lock);
+  proc->pgdir = pgdir;
+  proc->vm = vm;
+  if(--oldvm->ref > 0){
+    for(p = ptable.list; p; p = p->next){
+      if(p->pgdir == oldpgdir){
+        p->killed = 1;
+        if(p->state == SLEEPING)
+          p->state = RUNNABLE;
+      }
+    }
+    oldpgdir = 0;
+  }
+  release(&ptable.lock);
+  switchuvm(proc);
+  if(oldpgdir){
+    freevm(oldpgdir);
+    vmspacefree(oldvm);
+  }
+}
+
+// Copy the current thread's sz and shmsz to every other thread
+// sharing its page table, so their argument checks agree about
+// which memory exists after sbrk() or shmbrk().
+// Caller holds vmlock(), so that the threads' changes are not
+// interleaved.
+void
+threadsync(void)
+{
+  struct proc *p;
+
+  acquire(&ptable.lock);
+  for(p = ptable.list; p; p = p->next){
+    if(p != proc && p->pgdir == proc->pgdir){
+      p->sz = proc->sz;
+      p->shmsz = proc->shmsz;
+    }
+  }
+  release(&ptable.lock);
+}
+
 // Exit the current process.  Does not return.
 // An exited process remains in the zombie state
 // until its parent calls wait() to find out it exited.
-// wait() does final cleanup--stack, pagetable, proc[]
-// slot. We can't do those things here because the
+// wait() does final cleanup--stack, pagetable, proc. We can't do those things here because the
 // exiting process is still running. They have to happen
 // after entering the scheduler, at which point ZOMBIE
 // procs are guaranteed to not run again and can be safely
@@ -225,18 +524,12 @@ void
 exit(void)
 {
   struct proc *p;
-  int fd;
 
   if(proc == initproc)
     panic("init exiting");
 
   // Close all open files.
-  for(fd = 0; fd < NOFILE; fd++){
-    if(proc->ofile[fd]){
-      fileclose(proc->ofile[fd]);
-      proc->ofile[fd] = 0;
-    }
-  }
+  fdcloseall(proc);
 
   begin_op();
   iput(proc->cwd);
@@ -253,13 +546,17 @@ exit(void)
   // this one explicitly enters the scheduler.
   wakeup1(proc->parent);
 
-  // Pass abandoned children to init.
-  for(p = ptable.proc; p < &ptable.proc[NPROC]; p++){
-    if(p->parent == proc){
-      p->parent = initproc;
-      if(p->state == ZOMBIE)
-        wakeup1(initproc);
+  // Pass abandoned children to init. Our threads die
+  // with us; init reaps them like any other child.
+  while((p = proc->children) != 0){
+    if(p->pgdir == proc->pgdir){
+      p->killed = 1;
+      if(p->state == SLEEPING)
+        p->state = RUNNABLE;
     }
+    setparent(p, initproc);
+    if(p->state == ZOMBIE)
+      wakeup1(initproc);
   }
 
   // Jump into the scheduler, never to return.
@@ -268,6 +565,60 @@ exit(void)
   panic("zombie exit");
 }
 
+// Move p from its parent's children to parent's.
+// The ptable lock must be held.
+static void
+setparent(struct proc *p, struct proc *parent)
+{
+  if(p->parent){
+    if(p->sibprev)
+      p->sibprev->sibling = p->sibling;
+    else
+      p->parent->children = p->sibling;
+    if(p->sibling)
+      p->sibling->sibprev = p->sibprev;
+  }
+  p->parent = parent;
+  p->sibprev = 0;
+  p->sibling = 0;
+  if(parent){
+    p->sibling = parent->children;
+    if(parent->children)
+      parent->children->sibprev = p;
+    parent->children = p;
+  }
+}
+
+// Free a ZOMBIE (or never started) proc's kernel stack,
+// its page table unless another thread still uses it,
+// and the proc itself.
+// The ptable lock must be held.
+static void
+freeproc(struct proc *p)
+{
+  struct proc **pp;
+
+  kfree(p->kstack);
+  if(--p->vm->ref == 0){
+    if(p->pgdir)
+      freevm(p->pgdir);
+    vmspacefree(p->vm);
+  }
+  setparent(p, 0);
+  for(pp = &ptable.pidhash[p->pid % NPIDHASH]; *pp != p; pp = &(*pp)->hnext)
+    ;
+  *pp = p->hnext;
+  if(p->prev)
+    p->prev->next = p->next;
+  else
+    ptable.list = p->next;
+  if(p->next)
+    p->next->prev = p->prev;
+  ptable.nproc--;
+  p->state = UNUSED;
+  kmem_cache_free(ptable.cache, p);
+}
+
 // Wait for a child process to exit, clean it up,
 // and return its pid.
 // Return -1 if this process has no children.
@@ -282,21 +633,15 @@ wait(void)
   for(;;){
     // Scan through table looking for exited children.
     havekids = 0;
-    for(p = ptable.proc; p < &ptable.proc[NPROC]; p++){
-      if(p->parent != proc)
+    for(p = proc->children; p; p = p->sibling){
+      // Threads sharing our page table are reaped by join().
+      if(p->pgdir == proc->pgdir)
         continue;
       havekids = 1;
       if(p->state == ZOMBIE){
-        // Found one. Free stack, pagetable, and ptable.proc[] slot
+        // Found one. Free stack, pagetable, and proc
         pid = p->pid;
-        kfree(p->kstack);
-        p->kstack = 0;
-        freevm(p->pgdir);
-        p->pid = 0;
-        p->parent = 0;
-        p->name[0] = 0;
-        p->killed = 0;
-        p->state = UNUSED;
+        freeproc(p);
         release(&ptable.lock);
         return pid;
       }
@@ -334,6 +679,7 @@ void
 scheduler(void)
 {
   struct proc *p;
+  int ran;
 
   for(;;){
     // Enable interrupts on this processor. This, (and
@@ -348,16 +694,19 @@ scheduler(void)
 
     // Loop over process table looking for process to run.
     acquire(&ptable.lock);
-    for(p = ptable.proc; p < &ptable.proc[NPROC]; p++){
+    ran = 0;
+    for(p = ptable.list; p; p = p->next){
       if(p->state != RUNNABLE)
         continue;
 
+      ran = 1;
       // Switch to chosen process. Important: It is
       // the process's job to release ptable.lock
       // and then reacquire it before jumping back to us.
       proc = p;
       switchuvm(p);
       p->state = RUNNING;
+      TRACEPOINT(TR_SWITCH, p->pid, 0);
       swtch(&cpu->scheduler, p->context);
       // sched()'s `swtch` usually enters here
       switchkvm();
@@ -367,6 +716,10 @@ scheduler(void)
       proc = 0;
     }
     release(&ptable.lock);
+
+    // Nothing to run: zero a page for kalloc_zeroed().
+    if(!ran)
+      kzero();
   }
 }
 
@@ -487,11 +840,42 @@ wakeup1(void *chan)
 {
   struct proc *p;
 
-  for(p = ptable.proc; p < &ptable.proc[NPROC]; p++)
+  for(p = ptable.list; p; p = p->next)
     if(p->state == SLEEPING && p->chan == chan)
       p->state = RUNNABLE;
 }
 
+// Wake up at most n processes sleeping on chan,
+// and return how many were woken.
+// The ptable lock must be held.
+static int
+wakeupn1(void *chan, int n)
+{
+  struct proc *p;
+  int woken;
+
+  woken = 0;
+  for(p = ptable.list; p && woken < n; p = p->next){
+    if(p->state == SLEEPING && p->chan == chan){
+      p->state = RUNNABLE;
+      woken++;
+    }
+  }
+  return woken;
+}
+
+// Like wakeup, but wake at most n of the sleepers.
+int
+wakeupn(void *chan, int n)
+{
+  int woken;
+
+  acquire(&ptable.lock);
+  woken = wakeupn1(chan, n);
+  release(&ptable.lock);
+  return woken;
+}
+
 // Wake up all processes sleeping on chan.
 // Must already hold the relevant condition
 // lock to avoid the wakeup/sleep race.
@@ -505,6 +889,57 @@ wakeup(void *chan)
   release(&ptable.lock);
 }
 
+// Futexes let threads block on a word of user memory.
+// The sleep channel is the word's kernel address, so
+// threads of one process and processes sharing the
+// page through shmbrk() meet on the same channel.
+static void*
+futexchan(int *addr)
+{
+  char *ka;
+
+  // Touch the word first so that a lazily allocated
+  // page is mapped before we look it up.
+  (void)*(volatile int*)addr;
+  if((ka = uva2ka(proc->pgdir, (char*)PGROUNDDOWN((uint)addr))) == 0)
+    return 0;
+  return ka + ((uint)addr % PGSIZE);
+}
+
+// Sleep until woken by futexwake(addr), unless *addr no
+// longer holds val.  Checking *addr and going to sleep
+// happen under ptable.lock, so a waker that changes *addr
+// and then calls futexwake cannot be missed.
+// Returns 0 when woken, -1 if *addr != val.
+int
+futexwait(int *addr, int val)
+{
+  void *chan;
+
+  if((chan = futexchan(addr)) == 0)
+    return -1;
+  acquire(&ptable.lock);
+  if(*(volatile int*)addr != val){
+    release(&ptable.lock);
+    return -1;
+  }
+  sleep(chan, &ptable.lock);
+  release(&ptable.lock);
+  return 0;
+}
+
+// Wake at most n threads blocked in futexwait(addr).
+// Returns the number woken.
+int
+futexwake(int *addr, int n)
+{
+  void *chan;
+
+  if((chan = futexchan(addr)) == 0)
+    return -1;
+  return wakeupn(chan, n);
+}
+
 // Kill the process with the given pid.
 // Process won't exit until it returns
 // to user space (see trap in trap.c).
@@ -518,7 +953,7 @@ kill(int pid)
   struct proc *p;
 
   acquire(&ptable.lock);
-  for(p = ptable.proc; p < &ptable.proc[NPROC]; p++){
+  for(p = ptable.pidhash[(uint)pid % NPIDHASH]; p; p = p->hnext){
     if(p->pid == pid){
       p->killed = 1;
       // Wake process from sleep if necessary.
@@ -552,9 +987,7 @@ procdump(void)
   char *state;
   uint pc[10];
 
-  for(p = ptable.proc; p < &ptable.proc[NPROC]; p++){
-    if(p->state == UNUSED)
-      continue;
+  for(p = ptable.list; p; p = p->next){
     if(p->state >= 0 && p->state < NELEM(states) && states[p->state])
       state = states[p->state];
     else
@@ -48,24 +48,39 @@ struct context {
 
 enum procstate { UNUSED, EMBRYO, SLEEPING, RUNNABLE, RUNNING, ZOMBIE };
 
+// File descriptor table: fd is chunk[fd/NFDCHUNK][fd%NFDCHUNK].
+struct fdtable {
+  struct file **chunk[NOFILE/NFDCHUNK];
+  uint open[NOFILE/32];        // bitmap of open FDs
+};
+
 // Per-process state
 struct proc {
   uint sz;                     // Size of process memory (bytes)
+  uint shmsz;                  // Size of shared memory at SHMBASE (bytes)
   pde_t* pgdir;                // Page table
+  struct vmspace *vm;          // Shared with threads; see proc.c
   char *kstack;                // Bottom of kernel stack for this process
   enum procstate state;        // Process state
   int pid;                     // Process ID
   struct proc *parent;         // Parent process
+  void *ustack;                // User stack passed to clone(); 0 unless a thread
   struct trapframe *tf;        // Trap frame for current syscall
   struct context *context;     // swtch() here to run process
   void *chan;                  // If non-zero, sleeping on chan
   int killed;                  // If non-zero, have been killed
-  struct file *ofile[NOFILE];  // Open files--array of pointers to struct files. FDs index into this.
+  struct fdtable fdt;          // Open files; see fd.c
   struct inode *cwd;           // Current directory
   char name[16];               // Process name (debugging)
   int elapsed_ticks;
   int alarm_ticks;
   void (*alarm_fn)();
+  struct proc *next;           // On ptable's list of procs
+  struct proc *prev;
+  struct proc *hnext;          // Pid hash chain
+  struct proc *children;       // Procs whose parent this is
+  struct proc *sibling;        // On parent's children list
+  struct proc *sibprev;
 };
 
 // Process memory is laid out contiguously, low addresses first:
@@ -0,0 +1,215 @@
+// Kernel profiler.  Runs a command with the kernel sampling
+// profiler on, then lists the kernel functions where samples
+// landed, symbolized with kernel.sym.  "self" counts samples in
+// the function itself; "total" also counts samples in functions
+// it called, as far as the recorded call stacks reach.
+//
+// usage: prof [-r rate] [-n lines] command [args...]
+//   rate: samples per tick (1-16; more than 1 needs a LAPIC)
+
+#include "types.h"
+#include "stat.h"
+#include "user.h"
+#include "fcntl.h"
+#include "prof.h"
+#include "devrun.h"
+
+struct sym {
+  uint addr;
+  char *name;
+  int self;
+  int total;
+};
+
+struct sym *syms;
+int nsym;
+int nsample, nuser, nunknown;
+
+int
+hexval(char c)
+{
+  if(c >= '0' && c <= '9')
+    return c - '0';
+  if(c >= 'a' && c <= 'f')
+    return c - 'a' + 10;
+  return -1;
+}
+
+// Load "address name" lines from kernel.sym, sorted by address.
+void
+loadsyms(void)
+{
+  struct stat st;
+  struct sym t;
+  char *buf, *p, *e;
+  int fd, i, j, gap;
+
+  if((fd = open("kernel.sym", O_RDONLY)) < 0 || fstat(fd, &st) < 0){
+    printf(2, "prof: cannot read kernel.sym\n");
+    exit();
+  }
+  buf = malloc(st.size + 1);
+  if(read(fd, buf, st.size) != st.size){
+    printf(2, "prof: cannot read kernel.sym\n");
+    exit();
+  }
+  close(fd);
+  buf[st.size] = '\n';
+
+  nsym = 0;
+  for(p = buf; p < buf + st.size; p++)
+    if(*p == '\n')
+      nsym++;
+  syms = malloc(nsym * sizeof(struct sym));
+  memset(syms, 0, nsym * sizeof(struct sym));
+
+  nsym = 0;
+  for(p = buf; p < buf + st.size; p = e + 1){
+    for(e = p; *e != '\n'; e++)
+      ;
+    *e = 0;
+    t.addr = 0;
+    for(; hexval(*p) >= 0; p++)
+      t.addr = t.addr << 4 | hexval(*p);
+    if(*p != ' ' || t.addr == 0)
+      continue;
+    syms[nsym].addr = t.addr;
+    syms[nsym].name = p + 1;
+    nsym++;
+  }
+
+  // Shell sort by address.
+  for(gap = nsym/2; gap > 0; gap /= 2){
+    for(i = gap; i < nsym; i++){
+      t = syms[i];
+      for(j = i; j >= gap && syms[j-gap].addr > t.addr; j -= gap)
+        syms[j] = syms[j-gap];
+      syms[j] = t;
+    }
+  }
+}
+
+// The symbol containing pc, or -1.
+int
+lookup(uint pc)
+{
+  int lo, hi, mid;
+
+  if(nsym == 0 || pc < syms[0].addr)
+    return -1;
+  lo = 0;
+  hi = nsym - 1;
+  while(lo < hi){
+    mid = (lo + hi + 1) / 2;
+    if(syms[mid].addr <= pc)
+      lo = mid;
+    else
+      hi = mid - 1;
+  }
+  return lo;
+}
+
+void
+count(void *v)
+{
+  struct profsample *s = v;
+  int seen[PROFDEPTH+1];
+  int i, j, k, n;
+
+  nsample++;
+  if(s->user){
+    nuser++;
+    return;
+  }
+  if((k = lookup(s->eip)) < 0){
+    nunknown++;
+    return;
+  }
+  syms[k].self++;
+  seen[0] = k;
+  n = 1;
+  // Each caller's return address lies inside the caller.
+  for(i = 0; i < PROFDEPTH && s->pcs[i]; i++){
+    if((k = lookup(s->pcs[i] - 1)) < 0)
+      continue;
+    for(j = 0; j < n; j++)
+      if(seen[j] == k)
+        break;
+    if(j == n)
+      seen[n++] = k;
+  }
+  for(j = 0; j < n; j++)
+    syms[seen[j]].total++;
+}
+
+void
+report(int lines)
+{
+  struct sym t;
+  int i, j;
+
+  printf(1, "%d samples, %d in user mode, %d unknown\n",
+         nsample, nuser, nunknown);
+  if(nsample == 0)
+    return;
+  // Selection sort of the top entries by self, then total.
+  for(i = 0; i < lines && i < nsym; i++){
+    for(j = i + 1; j < nsym; j++){
+      if(syms[j].self > syms[i].self ||
+         (syms[j].self == syms[i].self && syms[j].total > syms[i].total)){
+        t = syms[i];
+        syms[i] = syms[j];
+        syms[j] = t;
+      }
+    }
+    if(syms[i].total == 0)
+      break;
+    if(i == 0)
+      printf(1, "self\ttotal\tfunction\n");
+    printf(1, "%d%%\t%d%%\t%s\n", syms[i].self * 100 / nsample,
+           syms[i].total * 100 / nsample, syms[i].name);
+  }
+}
+
+int
+main(int argc, char *argv[])
+{
+  int fd, rate, lines, i, n;
+  char cmd[16], *p;
+
+  rate = 1;
+  lines = 20;
+  for(i = 1; i + 1 < argc && argv[i][0] == '-'; i += 2){
+    if(strcmp(argv[i], "-r") == 0)
+      rate = atoi(argv[i+1]);
+    else if(strcmp(argv[i], "-n") == 0)
+      lines = atoi(argv[i+1]);
+    else
+      break;
+  }
+  if(i >= argc || argv[i][0] == '-' || rate < 1 || rate > MAXMULT){
+    printf(2, "usage: prof [-r rate] [-n lines] command [args...]\n");
+    exit();
+  }
+  loadsyms();
+
+  if((fd = open("prof", O_RDWR)) < 0){
+    printf(2, "prof: cannot open prof device\n");
+    exit();
+  }
+  // "start rate", built from the end of cmd.
+  p = cmd + sizeof(cmd);
+  *--p = 0;
+  for(n = rate; n > 0; n /= 10)
+    *--p = '0' + n % 10;
+  p -= 6;
+  memmove(p, "start ", 6);
+  if(devrun("prof", fd, p, "stop", argv + i,
+            sizeof(struct profsample), count) < 0){
+    printf(2, "prof: cannot start profiling\n");
+    exit();
+  }
+  close(fd);
+  report(lines);
+  exit();
+}
@@ -0,0 +1,14 @@
+// Kernel profiler samples, read from the prof device.
+// Write "start", "start n" (sample n times a tick) or "stop"
+// to the device to control it.
+
+#define PROF       2   // device major number
+#define PROFDEPTH  5   // callers recorded per sample
+#define MAXMULT    16  // most samples per tick
+
+struct profsample {
+  ushort cpu;
+  ushort user;              // 1 if the CPU was in user mode
+  uint eip;
+  uint pcs[PROFDEPTH];      // callers of eip's function, or 0
+};
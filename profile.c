@@ -0,0 +1,157 @@
+// Sampling kernel profiler.
+//
+// While profiling is on, each timer interrupt records the
+// interrupted eip and a few callers into its CPU's ring of
+// samples (see cpuring.c), drained by readers of the prof device
+// under prof.lock.  When a ring is full, samples are dropped.
+// A read waits until some ring is half full, or profiling stops;
+// once it has stopped and the rings are empty, reads return 0.
+//
+// For finer samples the local APIC timer can be made to fire
+// mult times per tick; the extra interrupts only take samples.
+
+#include "types.h"
+#include "defs.h"
+#include "param.h"
+#include "traps.h"
+#include "spinlock.h"
+#include "sleeplock.h"
+#include "fs.h"
+#include "file.h"
+#include "memlayout.h"
+#include "mmu.h"
+#include "proc.h"
+#include "x86.h"
+#include "cpuring.h"
+#include "prof.h"
+
+#define NPROFSAMP 512  // samples per CPU ring
+
+static struct {
+  struct spinlock lock;  // serializes readers and writers
+  int on;
+  int mult;              // timer interrupts per tick
+  struct cpuring ring[NCPU];
+  struct {
+    int mult;            // rate this CPU's timer runs at
+    int n;               // interrupts since the last tick
+  } cpu[NCPU];
+} prof;
+
+static struct profsample samples[NCPU][NPROFSAMP];
+
+// Called from the timer interrupt.  Take a sample if profiling,
+// and return 1 if this interrupt is an extra one that should not
+// count as a tick.
+int
+profintr(struct trapframe *tf)
+{
+  struct profsample *s;
+  uint pcs[10];
+  int id, i;
+
+  id = cpu - cpus;
+  if(prof.on){
+    if((s = cpuringslot(&prof.ring[id])) != 0){  // else drop
+      s->cpu = id;
+      s->user = (tf->cs & 3) == DPL_USER;
+      s->eip = tf->eip;
+      if(s->user)
+        pcs[0] = 0;
+      else
+        getcallerpcs((uint*)tf->ebp + 2, pcs);
+      for(i = 0; i < PROFDEPTH; i++)
+        s->pcs[i] = s->user ? 0 : pcs[i];
+      cpuringpush(&prof.ring[id]);
+      if(cpuringlen(&prof.ring[id]) >= NPROFSAMP/2)
+        wakeup(&prof);
+    }
+  }
+
+  if(lapic && prof.cpu[id].mult != prof.mult){
+    prof.cpu[id].mult = prof.mult;
+    prof.cpu[id].n = 0;
+    lapictimer(prof.mult);
+  }
+  if(++prof.cpu[id].n < prof.cpu[id].mult)
+    return 1;
+  prof.cpu[id].n = 0;
+  return 0;
+}
+
+// Copy out as many whole samples as fit in n bytes.
+static int
+profread(struct inode *ip, char *dst, int n)
+{
+  int m;
+
+  iunlock(ip);
+  acquire(&prof.lock);
+  while(prof.on && !cpuringready(prof.ring, ncpu, NPROFSAMP/2)){
+    if(proc->killed){
+      release(&prof.lock);
+      ilock(ip);
+      return -1;
+    }
+    sleep(&prof, &prof.lock);
+  }
+  m = cpuringread(prof.ring, ncpu, dst, n);
+  release(&prof.lock);
+  ilock(ip);
+  return m;
+}
+
+// "start [mult]" empties the rings and starts sampling,
+// "stop" stops it.
+static int
+profwrite(struct inode *ip, char *buf, int n)
+{
+  char cmd[16];
+  int id, mult, i, len;
+
+  if(n <= 0 || n >= sizeof(cmd))
+    return -1;
+  len = n;
+  memmove(cmd, buf, len);
+  cmd[len] = 0;
+  if(cmd[len-1] == '\n')
+    cmd[--len] = 0;
+
+  iunlock(ip);
+  acquire(&prof.lock);
+  if(strncmp(cmd, "stop", 5) == 0){
+    prof.on = 0;
+    prof.mult = 1;
+    wakeup(&prof);
+  } else if(strncmp(cmd, "start", 5) == 0 && (cmd[5] == 0 || cmd[5] == ' ')){
+    mult = 0;
+    for(i = 6; i < len && cmd[i] >= '0' && cmd[i] <= '9'; i++)
+      mult = mult*10 + cmd[i] - '0';
+    if(mult < 1 || !lapic)
+      mult = 1;
+    if(mult > MAXMULT)
+      mult = MAXMULT;
+    for(id = 0; id < NCPU; id++)
+      cpuringclear(&prof.ring[id]);
+    prof.mult = mult;
+    prof.on = 1;
+  } else
+    n = -1;
+  release(&prof.lock);
+  ilock(ip);
+  return n;
+}
+
+void
+profinit(void)
+{
+  int id;
+
+  initlock(&prof.lock, "prof");
+  for(id = 0; id < NCPU; id++)
+    cpuringinit(&prof.ring[id], samples[id], sizeof(struct profsample),
+                NPROFSAMP);
+  prof.mult = 1;
+  devsw[PROF].read = profread;
+  devsw[PROF].write = profwrite;
+}
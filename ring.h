@@ -0,0 +1,38 @@
+// Batched system calls.  The caller fills submission queue
+// entries in a struct ring in its own memory and calls
+// ring_enter(), which runs them in order and posts one
+// completion per entry.  Head and tail are free-running
+// counters; slot i is at index i % RINGSIZE.
+
+#define RINGSIZE 32
+
+#define RING_READ   1   // read(fd, addr, n)
+#define RING_WRITE  2   // write(fd, addr, n)
+#define RING_OPEN   3   // open(addr, n)
+#define RING_CLOSE  4   // close(fd)
+#define RING_FSTAT  5   // fstat(fd, addr)
+
+#define RING_LINK   0x1 // use the fd from the batch's last RING_OPEN
+
+struct sqe {
+  short op;
+  short flags;
+  int fd;
+  void *addr;
+  int n;
+  uint data;      // copied to the completion
+};
+
+struct cqe {
+  uint data;
+  int res;        // what the system call would have returned
+};
+
+struct ring {
+  uint sqhead;    // advanced by the kernel
+  uint sqtail;    // advanced by the caller
+  uint cqhead;    // advanced by the caller
+  uint cqtail;    // advanced by the kernel
+  struct sqe sq[RINGSIZE];
+  struct cqe cq[RINGSIZE];
+};
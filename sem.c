@@ -0,0 +1,129 @@
+#include "types.h"
+#include "defs.h"
+#include "param.h"
+#include "mmu.h"
+#include "proc.h"
+#include "fs.h"
+#include "spinlock.h"
+#include "sleeplock.h"
+#include "file.h"
+#include "fcntl.h"
+
+// Event counters, opened with eventfd().  A write adds to the
+// count and a read takes it back.  With EFD_SEMAPHORE a read
+// takes 1, so the fd acts as a counting semaphore; otherwise a
+// read takes the whole count.  Unlike a pipe there is no data to
+// copy, and a write wakes only as many readers as it can satisfy.
+
+#define SEMMAX 0x7fffffff
+
+struct sem {
+  struct spinlock lock;
+  uint count;
+  int flags;      // EFD_SEMAPHORE, EFD_NONBLOCK
+  int nreaders;   // readers sleeping on count
+  int nwriters;   // writers sleeping on flags
+};
+
+static struct kmem_cache *semcache;
+
+void
+seminit(void)
+{
+  semcache = kmem_cache_create("sem", sizeof(struct sem));
+}
+
+int
+semalloc(struct file **f, int count, int flags)
+{
+  struct sem *s;
+
+  if(count < 0)
+    return -1;
+  if((*f = filealloc()) == 0)
+    return -1;
+  if((s = kmem_cache_alloc(semcache)) == 0){
+    fileclose(*f);
+    return -1;
+  }
+  initlock(&s->lock, "sem");
+  s->count = count;
+  s->flags = flags;
+  s->nreaders = 0;
+  s->nwriters = 0;
+  (*f)->type = FD_SEM;
+  (*f)->readable = 1;
+  (*f)->writable = 1;
+  (*f)->sem = s;
+  return 0;
+}
+
+// Called when the last file referring to s is closed;
+// nobody can be sleeping on it any more.
+void
+semclose(struct sem *s)
+{
+  kmem_cache_free(semcache, s);
+}
+
+// Read the count into addr as an int.
+int
+semread(struct sem *s, char *addr, int n)
+{
+  int v;
+
+  if(n < sizeof(int))
+    return -1;
+  acquire(&s->lock);
+  while(s->count == 0){
+    if((s->flags & EFD_NONBLOCK) || proc->killed){
+      release(&s->lock);
+      return -1;
+    }
+    s->nreaders++;
+    sleep(&s->count, &s->lock);
+    s->nreaders--;
+  }
+  if(s->flags & EFD_SEMAPHORE){
+    v = 1;
+    s->count--;
+  } else {
+    v = s->count;
+    s->count = 0;
+  }
+  if(s->nwriters)
+    wakeup(&s->flags);
+  release(&s->lock);
+  *(int*)addr = v;
+  return sizeof(int);
+}
+
+// Add the int at addr to the count.
+int
+semwrite(struct sem *s, char *addr, int n)
+{
+  int v;
+
+  if(n < sizeof(int))
+    return -1;
+  v = *(int*)addr;
+  if(v < 0)
+    return -1;
+  acquire(&s->lock);
+  while(s->count > SEMMAX - v){
+    if((s->flags & EFD_NONBLOCK) || proc->killed){
+      release(&s->lock);
+      return -1;
+    }
+    s->nwriters++;
+    sleep(&s->flags, &s->lock);
+    s->nwriters--;
+  }
+  s->count += v;
+  // A semaphore can satisfy v readers; a counter is
+  // drained by the first reader, so wake just one.
+  if(v > 0 && s->nreaders)
+    wakeupn(&s->count, (s->flags & EFD_SEMAPHORE) ? v : 1);
+  release(&s->lock);
+  return sizeof(int);
+}
@@ -0,0 +1,199 @@
+// Slab allocator for small kernel objects.
+//
+// A kmem_cache hands out objects of one size, carved from pages
+// (slabs) got from kalloc().  Each slab begins with a header
+// holding its free objects, linked through their first word, so
+// kmem_cache_free() finds an object's slab by rounding its
+// address down to a page.  A slab is given back to kalloc() when
+// all its objects are free.
+//
+// In front of the slabs each CPU keeps a magazine of free
+// objects, used with interrupts off but without the cache's
+// lock.  Most allocations and frees touch only the magazine; the
+// lock is taken to refill an empty one or spill a full one,
+// MAGSIZE/2 objects at a time.
+
+#include "types.h"
+#include "defs.h"
+#include "param.h"
+#include "memlayout.h"
+#include "mmu.h"
+#include "proc.h"
+#include "spinlock.h"
+
+#define NCACHE   8   // caches in the system
+#define MAGSIZE  16  // objects per magazine
+
+struct slab {
+  struct kmem_cache *cache;
+  struct slab *prev;   // on cache's partial list,
+  struct slab *next;   // if nfree > 0
+  void *free;          // free objects
+  int nfree;
+};
+
+struct kmem_cache {
+  struct spinlock lock;
+  char *name;
+  uint size;          // bytes per object
+  int perslab;        // objects per slab
+  struct slab *partial;  // slabs with free objects
+  int nslab;
+  struct {
+    int n;
+    void *obj[MAGSIZE];
+  } mag[NCPU];
+};
+
+static struct kmem_cache caches[NCACHE];
+static int ncaches;
+
+// Objects start after the slab header, word aligned.
+#define SLABHDR  ((sizeof(struct slab) + 7) & ~7)
+
+// Make a cache of objects of size bytes.
+// Called once for each cache, while booting.
+struct kmem_cache*
+kmem_cache_create(char *name, uint size)
+{
+  struct kmem_cache *c;
+
+  size = (size + 3) & ~3;
+  if(size < sizeof(void*))
+    size = sizeof(void*);
+  if(size > PGSIZE - SLABHDR)
+    panic("kmem_cache_create: size");
+
+  if(ncaches >= NCACHE)
+    panic("kmem_cache_create: too many");
+  c = &caches[ncaches++];
+  initlock(&c->lock, name);
+  c->name = name;
+  c->size = size;
+  c->perslab = (PGSIZE - SLABHDR) / size;
+  return c;
+}
+
+// Take an object from c's slabs, getting a new slab
+// if none has a free object.  Caller holds c->lock.
+static void*
+slabget(struct kmem_cache *c)
+{
+  struct slab *s;
+  char *p;
+  void *obj;
+  int i;
+
+  if((s = c->partial) == 0){
+    if((s = (struct slab*)kalloc()) == 0)
+      return 0;
+    s->cache = c;
+    s->free = 0;
+    p = (char*)s + SLABHDR;
+    for(i = 0; i < c->perslab; i++, p += c->size){
+      *(void**)p = s->free;
+      s->free = p;
+    }
+    s->nfree = c->perslab;
+    s->prev = 0;
+    s->next = 0;
+    c->partial = s;
+    c->nslab++;
+  }
+  obj = s->free;
+  s->free = *(void**)obj;
+  if(--s->nfree == 0){
+    c->partial = s->next;
+    if(s->next)
+      s->next->prev = 0;
+  }
+  return obj;
+}
+
+// Give obj back to its slab, and the slab back to kalloc()
+// if it is now unused.  Caller holds c->lock.
+static void
+slabput(struct kmem_cache *c, void *obj)
+{
+  struct slab *s;
+
+  s = (struct slab*)PGROUNDDOWN((uint)obj);
+  if(s->cache != c)
+    panic("kmem_cache_free: wrong cache");
+  *(void**)obj = s->free;
+  s->free = obj;
+  if(s->nfree++ == 0){
+    s->prev = 0;
+    s->next = c->partial;
+    if(c->partial)
+      c->partial->prev = s;
+    c->partial = s;
+  }
+  if(s->nfree == c->perslab){
+    if(s->prev)
+      s->prev->next = s->next;
+    else
+      c->partial = s->next;
+    if(s->next)
+      s->next->prev = s->prev;
+    c->nslab--;
+    kfree((char*)s);
+  }
+}
+
+// Allocate an object from c.  Its contents are undefined.
+// Returns 0 if out of memory.
+void*
+kmem_cache_alloc(struct kmem_cache *c)
+{
+  void *obj;
+  int id;
+
+  pushcli();
+  id = cpu - cpus;
+  if(c->mag[id].n > 0){
+    obj = c->mag[id].obj[--c->mag[id].n];
+    popcli();
+    return obj;
+  }
+  popcli();
+
+  // acquire() disables interrupts, so we stay on this CPU.
+  acquire(&c->lock);
+  id = cpu - cpus;
+  while(c->mag[id].n < MAGSIZE/2 && (obj = slabget(c)) != 0)
+    c->mag[id].obj[c->mag[id].n++] = obj;
+  obj = 0;
+  if(c->mag[id].n > 0)
+    obj = c->mag[id].obj[--c->mag[id].n];
+  release(&c->lock);
+  return obj;
+}
+
+// Free an object allocated from c.
+void
+kmem_cache_free(struct kmem_cache *c, void *obj)
+{
+  int id;
+
+#ifdef KMEMDEBUG
+  // Fill with junk to catch dangling refs.
+  memset(obj, 1, c->size);
+#endif
+
+  pushcli();
+  id = cpu - cpus;
+  if(c->mag[id].n < MAGSIZE){
+    c->mag[id].obj[c->mag[id].n++] = obj;
+    popcli();
+    return;
+  }
+  popcli();
+
+  acquire(&c->lock);
+  id = cpu - cpus;
+  while(c->mag[id].n > MAGSIZE/2)
+    slabput(c, c->mag[id].obj[--c->mag[id].n]);
+  slabput(c, obj);
+  release(&c->lock);
+}
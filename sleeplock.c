@@ -16,25 +16,56 @@ initsleeplock(struct sleeplock *lk, char *name)
   initlock(&lk->lk, "sleep lock");
   lk->name = name;
   lk->locked = 0;
+  lk->readers = 0;
+  lk->wwait = 0;
   lk->pid = 0;
 }
 
+// Acquire exclusively, once there are no other holders.
 void
 acquiresleep(struct sleeplock *lk)
 {
   acquire(&lk->lk);
-  while (lk->locked) {
+  lk->wwait++;
+  while (lk->locked || lk->readers) {
     sleep(lk, &lk->lk);
   }
+  lk->wwait--;
   lk->locked = 1;
   lk->pid = proc->pid;
   release(&lk->lk);
 }
 
+// Acquire shared with other readers.  Waits behind an
+// exclusive acquirer so that readers cannot starve it.
+void
+acquiresleepshared(struct sleeplock *lk)
+{
+  acquire(&lk->lk);
+  while (lk->locked || lk->wwait) {
+    sleep(lk, &lk->lk);
+  }
+  lk->readers++;
+  release(&lk->lk);
+}
+
+void
+releasesleepshared(struct sleeplock *lk)
+{
+  acquire(&lk->lk);
+  if (lk->readers < 1)
+    panic("releasesleepshared");
+  if (--lk->readers == 0)
+    wakeup(lk);
+  release(&lk->lk);
+}
+
 void
 releasesleep(struct sleeplock *lk)
 {
   acquire(&lk->lk);
+  if (!lk->locked)
+    panic("releasesleep");
   lk->locked = 0;
   lk->pid = 0;
   wakeup(lk);
@@ -47,7 +78,7 @@ holdingsleep(struct sleeplock *lk)
   int r;
   
   acquire(&lk->lk);
-  r = lk->locked;
+  r = lk->locked || lk->readers;
   release(&lk->lk);
   return r;
 }
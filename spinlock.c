@@ -8,13 +8,49 @@
 #include "mmu.h"
 #include "proc.h"
 #include "spinlock.h"
+#include "lockstat.h"
+
+// Statistics for each lock name.  initlock can run before
+// there is a cpu structure for acquire, so the table has a
+// bare xchg lock of its own.
+static struct lockclass lockclass[NLOCKCLASS];
+static uint nlockclass;
+static uint lockclassbusy;
+
+// Find or make the statistics entry for locks named name.
+static struct lockclass*
+lookupclass(char *name)
+{
+  struct lockclass *c;
+  uint eflags;
+
+  eflags = readeflags();
+  cli();
+  while(xchg(&lockclassbusy, 1) != 0)
+    ;
+  for(c = lockclass; c < lockclass+nlockclass; c++)
+    if(c->name == name || strncmp(c->name, name, 16) == 0)
+      goto found;
+  if(nlockclass < NLOCKCLASS){
+    c = &lockclass[nlockclass++];
+    c->name = name;
+  } else
+    c = 0;
+found:
+  xchg(&lockclassbusy, 0);
+  if(eflags & FL_IF)
+    sti();
+  return c;
+}
 
 void
 initlock(struct spinlock *lk, char *name)
 {
   lk->name = name;
-  lk->locked = 0;
+  lk->next = 0;
+  lk->owner = 0;
   lk->cpu = 0;
+  lk->stat = lookupclass(name);
 }
 
 // Acquire the lock.
@@ -33,13 +69,26 @@ acquire(struct spinlock *lk)
   // until the ISR returned.) XV6 takes a
   // conservative approach and disables interrupts
   // when acquiring any spinlock.
+  uint ticket;
+  unsigned long long t0;
+
   pushcli();
   if(holding(lk))
     panic("acquire");
 
-  // The xchg is atomic.
-  while(xchg(&lk->locked, 1) != 0)
-    ;
+  // Taking a ticket is atomic (lock xadd).  Waiters only read
+  // owner, so the cache line moves once per handoff rather
+  // than on every spin.
+  ticket = __sync_fetch_and_add(&lk->next, 1);
+  if(*(volatile uint*)&lk->owner != ticket){
+    t0 = rdtsc();
+    while(*(volatile uint*)&lk->owner != ticket)
+      pause();
+    if(lk->stat){
+      lk->stat->cpu[cpu-cpus].ncontend++;
+      lk->stat->cpu[cpu-cpus].spin += rdtsc() - t0;
+    }
+  }
 
   // Tell the C compiler and the processor to not move loads or stores
   // past this point, to ensure that all the stores in the critical
@@ -52,6 +101,8 @@ acquire(struct spinlock *lk)
   __sync_synchronize();
 
   // Record info about lock acquisition for debugging.
+  if(lk->stat)
+    lk->stat->cpu[cpu-cpus].nacquire++;
   lk->cpu = cpu;
   getcallerpcs(&lk, lk->pcs);
 }
@@ -68,13 +119,9 @@ release(struct spinlock *lk)
 
   __sync_synchronize();
 
-  // Release the lock, equivalent to lk->locked = 0.
-  // This code can't use a C assignment, since it might
-  // not be atomic. A real OS would use C atomics here.
-  // TODO: Couldn't you juse use `xchg` here like in
-  // acquire, and just ignore the return value? Maybe
-  // that's more expensive...
-  asm volatile("movl $0, %0" : "+m" (lk->locked) : );
+  // Serve the next ticket.  Only the holder writes owner,
+  // so a plain store is enough.
+  *(volatile uint*)&lk->owner = lk->owner + 1;
 
   popcli();  // Re-enable interrupts
 }
@@ -101,7 +148,39 @@ getcallerpcs(void *v, uint pcs[])
 int
 holding(struct spinlock *lock)
 {
-  return lock->locked && lock->cpu == cpu;
+  return lock->next != lock->owner && lock->cpu == cpu;
+}
+
+// Copy statistics for up to n lock names to ls, summed over
+// CPUs.  Return the number copied.  lockstatread(0, 0) resets
+// the counters instead.
+int
+lockstatread(struct lockstat *ls, int n)
+{
+  struct lockclass *c;
+  unsigned long long spin;
+  int i, k;
+
+  for(k = 0, c = lockclass; c < lockclass+nlockclass; c++){
+    if(ls == 0){
+      memset(c->cpu, 0, sizeof(c->cpu));
+      continue;
+    }
+    if(k >= n)
+      break;
+    safestrcpy(ls[k].name, c->name, sizeof(ls[k].name));
+    ls[k].nacquire = ls[k].ncontend = 0;
+    spin = 0;
+    for(i = 0; i < NCPU; i++){
+      ls[k].nacquire += c->cpu[i].nacquire;
+      ls[k].ncontend += c->cpu[i].ncontend;
+      spin += c->cpu[i].spin;
+    }
+    ls[k].spinlo = spin;
+    ls[k].spinhi = spin >> 32;
+    k++;
+  }
+  return k;
 }
 
 
@@ -1,11 +1,27 @@
 // Mutual exclusion lock.
+// A ticket lock: each acquirer takes the next ticket and
+// waits until owner reaches it, so CPUs get the lock in
+// the order they asked for it.
 struct spinlock {
-  uint locked;       // Is the lock held?
+  uint next;         // Next ticket to hand out
+  uint owner;        // Ticket now holding the lock
+                     // (the lock is free when next == owner)
 
   // For debugging:
   char *name;        // Name of lock.
   struct cpu *cpu;   // The cpu holding the lock.
   uint pcs[10];      // The call stack (an array of program counters)
                      // that locked the lock.
+  struct lockclass *stat;  // Contention statistics, or 0
 };
 
+// Contention statistics, shared by all locks with the same name
+// and counted per CPU so that no counter is shared between CPUs.
+struct lockclass {
+  char *name;
+  struct {
+    uint nacquire;            // acquisitions
+    uint ncontend;            // acquisitions that had to wait
+    unsigned long long spin;  // TSC cycles spent waiting
+  } cpu[NCPU];
+};
@@ -1,14 +1,31 @@
 #include "types.h"
 #include "x86.h"
+#include "mmu.h"
+
+// memset, memmove and memcmp work a word at a time with the
+// string instructions, and bytes only at the ragged ends.
+// There are no SSE versions: the kernel does not save FPU
+// state, so it cannot touch the XMM registers.
 
 void*
 memset(void *dst, int c, uint n)
 {
-  if ((int)dst%4 == 0 && n%4 == 0){
-    c &= 0xFF;
-    stosl(dst, (c<<24)|(c<<16)|(c<<8)|c, n/4);
-  } else
-    stosb(dst, c, n);
+  char *d;
+  uint head;
+
+  c &= 0xFF;
+  d = dst;
+  if(n >= 16){
+    // Bytes up to a word boundary, then words.
+    head = -(uint)d & 3;
+    stosb(d, c, head);
+    d += head;
+    n -= head;
+    stosl(d, c * 0x01010101, n/4);
+    d += n & ~3;
+    n &= 3;
+  }
+  stosb(d, c, n);
   return dst;
 }
 
@@ -19,6 +36,12 @@ memcmp(const void *v1, const void *v2, uint n)
 
   s1 = v1;
   s2 = v2;
+  // Skip equal words, then find the first differing byte.
+  while(n >= 4 && *(uint*)s1 == *(uint*)s2){
+    s1 += 4;
+    s2 += 4;
+    n -= 4;
+  }
   while(n-- > 0){
     if(*s1 != *s2)
       return *s1 - *s2;
@@ -33,17 +56,39 @@ memmove(void *dst, const void *src, uint n)
 {
   const char *s;
   char *d;
+  uint tail, eflags;
 
   s = src;
   d = dst;
   if(s < d && s + n > d){
-    s += n;
-    d += n;
-    while(n-- > 0)
-      *--d = *--s;
-  } else
-    while(n-- > 0)
-      *d++ = *s++;
+    // dst overlaps the end of src: copy from the top down,
+    // the odd bytes first and then words.  Interrupts stay off
+    // while the direction flag is set, so that no interrupt
+    // handler runs with it.  (Not pushcli: memmove runs before
+    // there is a cpu structure.)
+    tail = n & 3;
+    s += n - 1;
+    d += n - 1;
+    eflags = readeflags();
+    cli();
+    asm volatile("std\n\t"
+                 "rep movsb\n\t"
+                 "subl $3, %%esi\n\t"
+                 "subl $3, %%edi\n\t"
+                 "movl %3, %%ecx\n\t"
+                 "rep movsl\n\t"
+                 "cld" :
+                 "+D" (d), "+S" (s), "+c" (tail) :
+                 "r" (n/4) :
+                 "memory", "cc");
+    if(eflags & FL_IF)
+      sti();
+  } else {
+    // Forward rep movs is correct even when dst is below an
+    // overlapping src.
+    movsl(d, s, n/4);
+    movsb(d + (n & ~3), s + (n & ~3), n & 3);
+  }
 
   return dst;
 }
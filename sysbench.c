@@ -0,0 +1,48 @@
+// Null system call latency: time getpid() through
+// int $T_SYSCALL and through sysenter.
+//
+// usage: sysbench [calls]
+
+#include "types.h"
+#include "stat.h"
+#include "user.h"
+#include "x86.h"
+
+void
+bench(char *name, int (*call)(void), int n)
+{
+  unsigned long long t0, t1;
+  int i, ticks0, pid;
+
+  pid = getpid();
+  ticks0 = uptime();
+  t0 = rdtsc();
+  for(i = 0; i < n; i++){
+    if(call() != pid){
+      printf(2, "sysbench: %s returned the wrong pid\n", name);
+      exit();
+    }
+  }
+  t1 = rdtsc();
+  // No 64-bit division in user space; the difference
+  // fits in 32 bits unless the run takes seconds.
+  printf(1, "%s: %d calls, %d cycles/call, %d ticks\n",
+         name, n, (uint)(t1 - t0) / n, uptime() - ticks0);
+}
+
+int
+main(int argc, char *argv[])
+{
+  int n;
+
+  n = 100000;
+  if(argc > 1)
+    n = atoi(argv[1]);
+  if(n <= 0){
+    printf(2, "usage: sysbench [calls]\n");
+    exit();
+  }
+  bench("int getpid", getpid, n);
+  bench("sysenter getpid", fastgetpid, n);
+  exit();
+}
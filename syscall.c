@@ -6,6 +6,8 @@
 #include "proc.h"
 #include "x86.h"
 #include "syscall.h"
+#include "trace.h"
+#include "sysstat.h"
 
 // User code makes a system call with INT T_SYSCALL.
 // System call number in %eax.
@@ -13,11 +15,27 @@
 // library system call function. The saved user %esp points
 // to a saved program counter, and then the first argument.
 
+// Check that the n bytes at addr lie within the current
+// process's memory: either its private image below proc->sz
+// or its shared memory segment at SHMBASE.
+int
+validuaddr(uint addr, uint n)
+{
+  if(addr + n < addr)
+    return 0;
+  if(addr < proc->sz && addr+n <= proc->sz)
+    return 1;
+  if(addr >= SHMBASE && addr < SHMBASE+proc->shmsz &&
+     addr+n <= SHMBASE+proc->shmsz)
+    return 1;
+  return 0;
+}
+
 // Fetch the int at addr from the current process.
 int
 fetchint(uint addr, int *ip)
 {
-  if(addr >= proc->sz || addr+4 > proc->sz)
+  if(!validuaddr(addr, 4))
     return -1;
   *ip = *(int*)(addr);
   return 0;
@@ -31,10 +49,13 @@ fetchstr(uint addr, char **pp)
 {
   char *s, *ep;
 
-  if(addr >= proc->sz)
+  if(addr < proc->sz)
+    ep = (char*)proc->sz;
+  else if(addr >= SHMBASE && addr < SHMBASE+proc->shmsz)
+    ep = (char*)(SHMBASE+proc->shmsz);
+  else
     return -1;
   *pp = (char*)addr;
-  ep = (char*)proc->sz;
   for(s = *pp; s < ep; s++)
     if(*s == 0)
       return s - *pp;
@@ -58,7 +79,7 @@ argptr(int n, char **pp, int size)
 
   if(argint(n, &i) < 0)
     return -1;
-  if(size < 0 || (uint)i >= proc->sz || (uint)i+size > proc->sz)
+  if(size < 0 || !validuaddr(i, size))
     return -1;
   *pp = (char*)i;
   return 0;
@@ -66,8 +87,9 @@ argptr(int n, char **pp, int size)
 
 // Fetch the nth word-sized system call argument as a string pointer.
 // Check that the pointer is valid and the string is nul-terminated.
-// (There is no shared writable memory, so the string can't change
-// between this check and being used by the kernel.)
+// (A string in the shared memory segment could change between this
+// check and being used by the kernel; callers that care should copy
+// it out first.)
 int
 argstr(int n, char **pp)
 {
@@ -100,6 +122,21 @@ extern int sys_write(void);
 extern int sys_uptime(void);
 extern int sys_date(void);
 extern int sys_alarm(void);
+extern int sys_shmbrk(void);
+extern int sys_clone(void);
+extern int sys_join(void);
+extern int sys_futexwait(void);
+extern int sys_futexwake(void);
+extern int sys_eventfd(void);
+extern int sys_ring_enter(void);
+extern int sys_readv(void);
+extern int sys_writev(void);
+extern int sys_pread(void);
+extern int sys_pwrite(void);
+extern int sys_fsync(void);
+extern int sys_sync(void);
+extern int sys_lockstat(void);
+extern int sys_sysstat(void);
 
 static int (*syscalls[])(void) = {
 [SYS_fork]    = sys_fork,
@@ -125,45 +162,94 @@ static int (*syscalls[])(void) = {
 [SYS_close]   = sys_close,
 [SYS_date]    = sys_date,
 [SYS_alarm]   = sys_alarm,
+[SYS_shmbrk]  = sys_shmbrk,
+[SYS_clone]   = sys_clone,
+[SYS_join]    = sys_join,
+[SYS_futexwait] = sys_futexwait,
+[SYS_futexwake] = sys_futexwake,
+[SYS_eventfd] = sys_eventfd,
+[SYS_ring_enter] = sys_ring_enter,
+[SYS_readv]   = sys_readv,
+[SYS_writev]  = sys_writev,
+[SYS_pread]   = sys_pread,
+[SYS_pwrite]  = sys_pwrite,
+[SYS_fsync]   = sys_fsync,
+[SYS_sync]    = sys_sync,
+[SYS_lockstat] = sys_lockstat,
+[SYS_sysstat] = sys_sysstat,
 };
 
-// static char *syscall_strings[] = {
-//   [1] = "fork", // In syscall.h, SYS_fork is #define'd as 1
-//   "exit",
-//   "wait",
-//   "pipe",
-//   "read",
-//   "kill",
-//   "exec",
-//   "fstat",
-//   "chdir",
-//   "dup",
-//   "getpid",
-//   "sbrk",
-//   "sleep",
-//   "uptime",
-//   "open",
-//   "write",
-//   "mknod",
-//   "unlink",
-//   "link",
-//   "mkdir",
-//   "close",
-//   "date",
-//   "alarm",
-// };
+// Calls and time spent in each system call, kept per CPU
+// so that counting needs no lock, and summed by sysstatread.
+static struct {
+  uint ncall;
+  unsigned long long time;
+  uint hist[NSYSHIST];
+} sysstats[NCPU][NELEM(syscalls)];
+
+// Count a call to num that took t TSC cycles.  A call that
+// slept may have started on another CPU; it is counted here.
+static void
+sysaccount(int num, unsigned long long t)
+{
+  unsigned long long d;
+  int b;
+
+  b = 0;
+  for(d = t >> SYSHIST0; d != 0 && b < NSYSHIST-1; d >>= 1)
+    b++;
+  pushcli();
+  sysstats[cpu - cpus][num].ncall++;
+  sysstats[cpu - cpus][num].time += t;
+  sysstats[cpu - cpus][num].hist[b]++;
+  popcli();
+}
+
+// Copy statistics for system calls 0 to n-1 to ss, summed
+// over CPUs.  Return the number copied.  sysstatread(0, 0)
+// resets the counters instead.
+int
+sysstatread(struct sysstat *ss, int n)
+{
+  unsigned long long time;
+  int i, k, b;
+
+  if(ss == 0){
+    memset(sysstats, 0, sizeof(sysstats));
+    return 0;
+  }
+  if(n > NELEM(syscalls))
+    n = NELEM(syscalls);
+  for(k = 0; k < n; k++){
+    memset(&ss[k], 0, sizeof(ss[k]));
+    time = 0;
+    for(i = 0; i < NCPU; i++){
+      ss[k].ncall += sysstats[i][k].ncall;
+      time += sysstats[i][k].time;
+      for(b = 0; b < NSYSHIST; b++)
+        ss[k].hist[b] += sysstats[i][k].hist[b];
+    }
+    ss[k].timelo = time;
+    ss[k].timehi = time >> 32;
+  }
+  return n;
+}
 
 void
 syscall(void)
 {
+  unsigned long long t0;
   int num;
   int ret;
 
   num = proc->tf->eax;
   if(num > 0 && num < NELEM(syscalls) && syscalls[num]) {
+    TRACEPOINT(TR_SYSCALL, num, 0);
+    t0 = rdtsc();
     ret = syscalls[num]();
+    sysaccount(num, rdtsc() - t0);
     proc->tf->eax = ret;
-    // cprintf("\n%s -> %x\n", syscall_strings[num], ret);
+    TRACEPOINT(TR_SYSRET, num, ret);
   } else {
     cprintf("%d %s: unknown sys call %d\n",
             proc->pid, proc->name, num);
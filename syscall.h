@@ -22,3 +22,18 @@
 #define SYS_close   21
 #define SYS_date    22
 #define SYS_alarm   23
+#define SYS_shmbrk  24
+#define SYS_clone   25
+#define SYS_join    26
+#define SYS_futexwait 27
+#define SYS_futexwake 28
+#define SYS_eventfd 29
+#define SYS_ring_enter 30
+#define SYS_readv   31
+#define SYS_writev  32
+#define SYS_pread   33
+#define SYS_pwrite  34
+#define SYS_fsync   35
+#define SYS_sync    36
+#define SYS_lockstat 37
+#define SYS_sysstat 38
@@ -15,6 +15,8 @@
 #include "sleeplock.h"
 #include "file.h"
 #include "fcntl.h"
+#include "ring.h"
+#include "uio.h"
 
 // Fetch the nth word-sized system call argument as a file descriptor
 // and return both the descriptor and the corresponding struct file.
@@ -26,7 +28,7 @@ argfd(int n, int *pfd, struct file **pf)
 
   if(argint(n, &fd) < 0)
     return -1;
-  if(fd < 0 || fd >= NOFILE || (f=proc->ofile[fd]) == 0)
+  if((f = fd2file(fd)) == 0)
     return -1;
   if(pfd)
     *pfd = fd;
@@ -35,25 +37,6 @@ argfd(int n, int *pfd, struct file **pf)
   return 0;
 }
 
-// Allocate a file descriptor for the given file,
-// by scanning proc's FD table and modifying the first
-// free entry.
-// Takes over file reference from caller on success.
-// Returns the FD int on success, -1 on error.
-static int
-fdalloc(struct file *f)
-{
-  int fd;
-
-  for(fd = 0; fd < NOFILE; fd++){
-    if(proc->ofile[fd] == 0){
-      proc->ofile[fd] = f;
-      return fd;
-    }
-  }
-  return -1;
-}
-
 int
 sys_dup(void)
 {
@@ -92,19 +75,124 @@ sys_write(void)
   return filewrite(f, p, n);
 }
 
+// Fetch the nth word-sized system call argument as an array
+// of cnt iovecs and copy it to iov, checking that every buffer
+// lies in user memory.
+static int
+argiov(int n, int cnt, struct iovec *iov)
+{
+  char *p;
+  int i;
+
+  if(cnt < 0 || cnt > IOVMAX || argptr(n, &p, cnt*sizeof(*iov)) < 0)
+    return -1;
+  memmove(iov, p, cnt*sizeof(*iov));
+  for(i = 0; i < cnt; i++)
+    if(!validuaddr((uint)iov[i].base, iov[i].len))
+      return -1;
+  return 0;
+}
+
 int
-sys_close(void)
+sys_readv(void)
+{
+  struct file *f;
+  struct iovec iov[IOVMAX];
+  int n;
+
+  if(argfd(0, 0, &f) < 0 || argint(2, &n) < 0 || argiov(1, n, iov) < 0)
+    return -1;
+  return filereadv(f, iov, n, -1);
+}
+
+int
+sys_writev(void)
+{
+  struct file *f;
+  struct iovec iov[IOVMAX];
+  int n;
+
+  if(argfd(0, 0, &f) < 0 || argint(2, &n) < 0 || argiov(1, n, iov) < 0)
+    return -1;
+  return filewritev(f, iov, n, -1);
+}
+
+// pread and pwrite take an explicit offset and
+// leave the file's own offset alone.
+int
+sys_pread(void)
+{
+  struct file *f;
+  struct iovec iov;
+  int n, off;
+  char *p;
+
+  if(argfd(0, 0, &f) < 0 || argint(2, &n) < 0 || argptr(1, &p, n) < 0 ||
+     argint(3, &off) < 0 || off < 0)
+    return -1;
+  iov.base = p;
+  iov.len = n;
+  return filereadv(f, &iov, 1, off);
+}
+
+// There is one log, so making one file durable
+// means committing everything.
+int
+sys_fsync(void)
+{
+  struct file *f;
+
+  if(argfd(0, 0, &f) < 0 || f->type != FD_INODE)
+    return -1;
+  log_sync();
+  return 0;
+}
+
+int
+sys_sync(void)
+{
+  log_sync();
+  return 0;
+}
+
+int
+sys_pwrite(void)
+{
+  struct file *f;
+  struct iovec iov;
+  int n, off;
+  char *p;
+
+  if(argfd(0, 0, &f) < 0 || argint(2, &n) < 0 || argptr(1, &p, n) < 0 ||
+     argint(3, &off) < 0 || off < 0)
+    return -1;
+  iov.base = p;
+  iov.len = n;
+  return filewritev(f, &iov, 1, off);
+}
+
+static int
+fdclose(int fd)
 {
-  int fd;
   struct file *f;
 
-  if(argfd(0, &fd, &f) < 0)
+  if((f = fd2file(fd)) == 0)
     return -1;
-  proc->ofile[fd] = 0;
+  fdfree(fd);
   fileclose(f);
   return 0;
 }
 
+int
+sys_close(void)
+{
+  int fd;
+
+  if(argint(0, &fd) < 0)
+    return -1;
+  return fdclose(fd);
+}
+
 int
 sys_fstat(void)
 {
@@ -302,17 +390,14 @@ create(char *path, short type, short major, short minor)
   return ip;
 }
 
-int
-sys_open(void)
+// Open path and return a new file descriptor for it.
+static int
+openpath(char *path, int omode)
 {
-  char *path;
-  int fd, omode;
+  int fd;
   struct file *f;
   struct inode *ip;
 
-  if(argstr(0, &path) < 0 || argint(1, &omode) < 0)
-    return -1;
-
   begin_op();
 
   if(omode & O_CREATE){
@@ -350,9 +435,23 @@ sys_open(void)
   f->off = 0;
   f->readable = !(omode & O_WRONLY);
   f->writable = (omode & O_WRONLY) || (omode & O_RDWR);
+  f->sync = (omode & O_SYNC) != 0;
+  if(f->sync)
+    log_sync();
   return fd;
 }
 
+int
+sys_open(void)
+{
+  char *path;
+  int omode;
+
+  if(argstr(0, &path) < 0 || argint(1, &omode) < 0)
+    return -1;
+  return openpath(path, omode);
+}
+
 int
 sys_mkdir(void)
 {
@@ -456,7 +555,7 @@ sys_pipe(void)
       // Write FD alloc failed,
       // but Read FD alloc succeeded,
       // so we clean up the corresponding entry.
-      proc->ofile[fd0] = 0;
+      fdfree(fd0);
     fileclose(rf);
     fileclose(wf);
     return -1;
@@ -465,3 +564,89 @@ sys_pipe(void)
   fd[1] = fd1;
   return 0;
 }
+
+// Open a counter starting at count; see sem.c.
+int
+sys_eventfd(void)
+{
+  int count, flags, fd;
+  struct file *f;
+
+  if(argint(0, &count) < 0 || argint(1, &flags) < 0)
+    return -1;
+  if(semalloc(&f, count, flags) < 0)
+    return -1;
+  if((fd = fdalloc(f)) < 0){
+    fileclose(f);
+    return -1;
+  }
+  return fd;
+}
+
+// Run one ring entry; returns what the system call would.
+static int
+ringop(struct sqe *e)
+{
+  struct file *f;
+  char *path;
+
+  switch(e->op){
+  case RING_READ:
+  case RING_WRITE:
+    if(e->n < 0 || !validuaddr((uint)e->addr, e->n))
+      return -1;
+    if((f = fd2file(e->fd)) == 0)
+      return -1;
+    if(e->op == RING_READ)
+      return fileread(f, e->addr, e->n);
+    return filewrite(f, e->addr, e->n);
+  case RING_OPEN:
+    if(fetchstr((uint)e->addr, &path) < 0)
+      return -1;
+    return openpath(path, e->n);
+  case RING_CLOSE:
+    return fdclose(e->fd);
+  case RING_FSTAT:
+    if(!validuaddr((uint)e->addr, sizeof(struct stat)))
+      return -1;
+    if((f = fd2file(e->fd)) == 0)
+      return -1;
+    return filestat(f, (struct stat*)e->addr);
+  }
+  return -1;
+}
+
+// Run the entries queued in a struct ring (see ring.h), in
+// order, for the cost of one kernel entry.  Stops early if the
+// completion ring fills up.  Returns the number of entries run.
+int
+sys_ring_enter(void)
+{
+  struct ring *r;
+  struct sqe e;
+  struct cqe *c;
+  int n, res, linkfd;
+
+  if(argptr(0, (void*)&r, sizeof(*r)) < 0)
+    return -1;
+  n = 0;
+  linkfd = -1;
+  while(r->sqhead != r->sqtail && r->cqtail - r->cqhead < RINGSIZE){
+    // Copy the entry so the caller can't change it under us.
+    e = r->sq[r->sqhead % RINGSIZE];
+    if(e.flags & RING_LINK)
+      e.fd = linkfd;
+    res = ringop(&e);
+    if(e.op == RING_OPEN)
+      linkfd = res;
+    c = &r->cq[r->cqtail % RINGSIZE];
+    c->data = e.data;
+    c->res = res;
+    r->cqtail++;
+    r->sqhead++;
+    n++;
+    if(proc->killed)
+      break;
+  }
+  return n;
+}
@@ -0,0 +1,43 @@
+// System call names, indexed by number, for tools that
+// report on system calls.  Include after syscall.h.
+
+static char *syscall_strings[] = {
+[SYS_fork]    "fork",
+[SYS_exit]    "exit",
+[SYS_wait]    "wait",
+[SYS_pipe]    "pipe",
+[SYS_read]    "read",
+[SYS_kill]    "kill",
+[SYS_exec]    "exec",
+[SYS_fstat]   "fstat",
+[SYS_chdir]   "chdir",
+[SYS_dup]     "dup",
+[SYS_getpid]  "getpid",
+[SYS_sbrk]    "sbrk",
+[SYS_sleep]   "sleep",
+[SYS_uptime]  "uptime",
+[SYS_open]    "open",
+[SYS_write]   "write",
+[SYS_mknod]   "mknod",
+[SYS_unlink]  "unlink",
+[SYS_link]    "link",
+[SYS_mkdir]   "mkdir",
+[SYS_close]   "close",
+[SYS_date]    "date",
+[SYS_alarm]   "alarm",
+[SYS_shmbrk]  "shmbrk",
+[SYS_clone]   "clone",
+[SYS_join]    "join",
+[SYS_futexwait] "futexwait",
+[SYS_futexwake] "futexwake",
+[SYS_eventfd] "eventfd",
+[SYS_ring_enter] "ring_enter",
+[SYS_readv]   "readv",
+[SYS_writev]  "writev",
+[SYS_pread]   "pread",
+[SYS_pwrite]  "pwrite",
+[SYS_fsync]   "fsync",
+[SYS_sync]    "sync",
+[SYS_lockstat] "lockstat",
+[SYS_sysstat] "sysstat",
+};
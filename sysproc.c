@@ -6,6 +6,8 @@
 #include "memlayout.h"
 #include "mmu.h"
 #include "proc.h"
+#include "lockstat.h"
+#include "sysstat.h"
 
 int
 sys_fork(void)
@@ -50,11 +52,101 @@ sys_sbrk(void)
 
   if(argint(0, &n) < 0)
     return -1;
+  vmlock();
   addr = proc->sz;
+  if((n > 0 && (uint)n > SHMBASE - proc->sz) ||
+     (n < 0 && ((uint)-n > proc->sz || vmshared()))){
+    vmunlock();
+    return -1;
+  }
+  // Growth is lazy, but give shrunk pages back at once;
+  // so shrinking fails while threads share the memory.
+  if(n < 0)
+    deallocuvm(proc->pgdir, proc->sz, proc->sz + n);
   proc->sz = proc->sz + n;
+  threadsync();
+  vmunlock();
+  if(n < 0)
+    switchuvm(proc);
   return addr;
 }
 
+// Grow or shrink the shared memory segment by n bytes, like sbrk.
+// Returns the old end of the segment.  Unlike sbrk the pages are
+// allocated eagerly, so that a child forked afterwards maps the
+// same physical pages instead of faulting in private ones.
+int
+sys_shmbrk(void)
+{
+  int n;
+  uint addr;
+
+  if(argint(0, &n) < 0)
+    return -1;
+  vmlock();
+  addr = SHMBASE + proc->shmsz;
+  if(n > 0){
+    if((uint)n > SHMTOP - addr || allocuvm(proc->pgdir, addr, addr + n) == 0){
+      vmunlock();
+      return -1;
+    }
+  } else if(n < 0){
+    if((uint)-n > proc->shmsz || vmshared()){
+      vmunlock();
+      return -1;
+    }
+    deallocuvm(proc->pgdir, addr, addr + n);
+  }
+  proc->shmsz += n;
+  threadsync();
+  vmunlock();
+  switchuvm(proc);
+  return addr;
+}
+
+int
+sys_clone(void)
+{
+  int fn, arg;
+  char *stack;
+
+  if(argint(0, &fn) < 0 || argint(1, &arg) < 0)
+    return -1;
+  if(argptr(2, &stack, PGSIZE) < 0)
+    return -1;
+  return clone((void(*)(void*))fn, (void*)arg, stack);
+}
+
+int
+sys_join(void)
+{
+  void **stack;
+
+  if(argptr(0, (void*)&stack, sizeof(*stack)) < 0)
+    return -1;
+  return join(stack);
+}
+
+int
+sys_futexwait(void)
+{
+  int *addr, val;
+
+  if(argptr(0, (void*)&addr, sizeof(*addr)) < 0 || argint(1, &val) < 0)
+    return -1;
+  return futexwait(addr, val);
+}
+
+int
+sys_futexwake(void)
+{
+  int *addr, n;
+
+  if(argptr(0, (void*)&addr, sizeof(*addr)) < 0 || argint(1, &n) < 0)
+    return -1;
+  return futexwake(addr, n);
+}
+
 int
 sys_sleep(void)
 {
@@ -95,7 +187,8 @@ sys_alarm(void)
   int intrvl; // Clock tick interval
   void (*handler)(); // Callback pointer
 
-  if(argint(0, &intrvl) < 0 || intrvl <= 0)
+  // An interval of 0 turns the alarm off.
+  if(argint(0, &intrvl) < 0 || intrvl < 0)
     return -1;
   if(argptr(1, (void*)&handler, sizeof(handler)) < 0)
     return -1;
@@ -104,3 +197,42 @@ sys_alarm(void)
   proc->alarm_fn = handler;
   return 0;
 }
+
+// Copy lock statistics to the user's array of n entries and
+// return how many were filled in; lockstat(0, 0) resets them.
+int
+sys_lockstat(void)
+{
+  char *p;
+  int n;
+
+  if(argint(1, &n) < 0 || n < 0)
+    return -1;
+  if(n > NLOCKCLASS)
+    n = NLOCKCLASS;
+  if(argptr(0, &p, n*sizeof(struct lockstat)) < 0)
+    return -1;
+  if(n == 0)
+    return lockstatread(0, 0);
+  return lockstatread((struct lockstat*)p, n);
+}
+
+// Copy system call statistics, indexed by call number, to the
+// user's array of n entries and return how many were filled in;
+// sysstat(0, 0) resets them.
+int
+sys_sysstat(void)
+{
+  char *p;
+  int n;
+
+  if(argint(1, &n) < 0 || n < 0)
+    return -1;
+  if(n > NSYSCALL)
+    n = NSYSCALL;
+  if(argptr(0, &p, n*sizeof(struct sysstat)) < 0)
+    return -1;
+  if(n == 0)
+    return sysstatread(0, 0);
+  return sysstatread((struct sysstat*)p, n);
+}
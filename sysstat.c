@@ -0,0 +1,153 @@
+// Print system call statistics: the calls that took the most
+// time in total, with their median and 99th percentile latency
+// (as powers of two, from the kernel's histograms).  With a
+// command, reset the counters, run the command, and print what
+// the system did meanwhile.
+//
+// usage: sysstat [-n lines] [command [args...]]
+
+#include "types.h"
+#include "stat.h"
+#include "user.h"
+#include "x86.h"
+#include "memlayout.h"
+#include "date.h"
+#include "vdso.h"
+#include "syscall.h"
+#include "sysnames.h"
+#include "sysstat.h"
+
+struct sysstat ss[NSYSCALL];
+int order[NSYSCALL];
+uint tscperus;
+
+uint
+micros(uint hi, uint lo)
+{
+  if(hi >= tscperus)
+    return 0xFFFFFFFF;
+  return div64(hi, lo, tscperus);
+}
+
+// Take out our own wait() for the command, which took t cycles,
+// assuming it was the slowest wait().
+void
+uncount(unsigned long long t)
+{
+  struct sysstat *s;
+  unsigned long long time;
+  int b;
+
+  s = &ss[SYS_wait];
+  if(s->ncall == 0)
+    return;
+  s->ncall--;
+  time = (unsigned long long)s->timehi << 32 | s->timelo;
+  time = time > t ? time - t : 0;
+  s->timelo = time;
+  s->timehi = time >> 32;
+  for(b = NSYSHIST-1; b > 0 && s->hist[b] == 0; b--)
+    ;
+  if(s->hist[b] > 0)
+    s->hist[b]--;
+}
+
+// Print the latency below which fraction num/100 of s's calls fell.
+void
+percentile(struct sysstat *s, int num)
+{
+  uint n, want;
+  int b;
+
+  want = s->ncall / 100 * num + (s->ncall % 100 * num + 99) / 100;
+  n = 0;
+  for(b = 0; b < NSYSHIST-1; b++){
+    n += s->hist[b];
+    if(n >= want)
+      break;
+  }
+  if(b == NSYSHIST-1)
+    printf(1, "\t>%d", micros(0, 1 << (SYSHIST0+b-1)));
+  else
+    printf(1, "\t<%d", micros(0, 1 << (SYSHIST0+b)) + 1);
+}
+
+int
+main(int argc, char *argv[])
+{
+  unsigned long long t0;
+  uint tot, sum;
+  int i, j, n, t, lines, pid;
+  char *name;
+
+  lines = 10;
+  i = 1;
+  if(i + 1 < argc && strcmp(argv[i], "-n") == 0){
+    lines = atoi(argv[i+1]);
+    i += 2;
+  }
+  t0 = 0;
+  if(i < argc){
+    if(argv[i][0] == '-'){
+      printf(2, "usage: sysstat [-n lines] [command [args...]]\n");
+      exit();
+    }
+    sysstat(0, 0);
+    t0 = rdtsc();
+    pid = fork();
+    if(pid < 0){
+      printf(2, "sysstat: fork failed\n");
+      exit();
+    }
+    if(pid == 0){
+      exec(argv[i], argv+i);
+      printf(2, "sysstat: exec %s failed\n", argv[i]);
+      exit();
+    }
+    wait();
+    t0 = rdtsc() - t0;
+  }
+
+  if((n = sysstat(ss, NSYSCALL)) < 0){
+    printf(2, "sysstat: sysstat failed\n");
+    exit();
+  }
+  if(t0)
+    uncount(t0);
+  tscperus = ((struct vdso*)VDSO)->tscperus;
+  if(tscperus == 0){
+    printf(2, "sysstat: no time-stamp counter rate\n");
+    exit();
+  }
+
+  // Most time first.
+  sum = 0;
+  for(i = 0; i < n; i++){
+    sum += micros(ss[i].timehi, ss[i].timelo);
+    t = i;
+    for(j = i; j > 0 && (ss[order[j-1]].timehi < ss[t].timehi ||
+        (ss[order[j-1]].timehi == ss[t].timehi &&
+         ss[order[j-1]].timelo < ss[t].timelo)); j--)
+      order[j] = order[j-1];
+    order[j] = t;
+  }
+
+  printf(1, "call\tcalls\ttime-us\t%%time\tavg-us\tp50-us\tp99-us\n");
+  for(i = 0; i < n && i < lines; i++){
+    j = order[i];
+    if(ss[j].ncall == 0)
+      break;
+    name = "?";
+    if(j < sizeof(syscall_strings)/sizeof(syscall_strings[0]) &&
+       syscall_strings[j])
+      name = syscall_strings[j];
+    tot = micros(ss[j].timehi, ss[j].timelo);
+    printf(1, "%s\t%d\t%d\t%d\t%d", name, ss[j].ncall, tot,
+           sum >= 100 ? tot / (sum / 100) : tot * 100 / (sum + 1),
+           tot / ss[j].ncall);
+    percentile(&ss[j], 50);
+    percentile(&ss[j], 99);
+    printf(1, "\n");
+  }
+  exit();
+}
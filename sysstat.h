@@ -0,0 +1,17 @@
+// System call statistics, as returned by sysstat(), one entry
+// per system call number.
+
+#define NSYSCALL 64  // at most this many system call numbers
+#define NSYSHIST 20  // latency histogram buckets
+
+// Bucket 0 counts calls that took under 2^SYSHIST0 TSC cycles,
+// bucket i > 0 those that took [2^(SYSHIST0+i-1), 2^(SYSHIST0+i)),
+// and the last bucket everything slower.
+#define SYSHIST0 10
+
+struct sysstat {
+  uint ncall;          // calls that returned
+  uint timelo;         // TSC cycles spent in them, low 32 bits
+  uint timehi;         // and high 32 bits
+  uint hist[NSYSHIST];
+};
@@ -0,0 +1,184 @@
+// Kernel tracepoints.
+//
+// A tracepoint costs a test of tracemask while its event type is
+// off.  When on, it appends a timestamped event to its CPU's
+// ring (see cpuring.c), drained by readers of the trace device
+// under tr.lock.  A full ring drops events and says how many
+// with a TR_LOST event once there is room again.
+//
+// Tracepoints run in places such as the scheduler that hold
+// ptable.lock, so they never wake the reader.  Instead a read
+// polls once a tick until some ring is half full, or a second
+// has passed and there is anything at all.  Once tracing is off
+// and the rings are empty, reads return 0.
+
+#include "types.h"
+#include "defs.h"
+#include "param.h"
+#include "traps.h"
+#include "spinlock.h"
+#include "sleeplock.h"
+#include "fs.h"
+#include "file.h"
+#include "memlayout.h"
+#include "mmu.h"
+#include "proc.h"
+#include "x86.h"
+#include "cpuring.h"
+#include "trace.h"
+
+#define NTRACE    1024  // events per CPU ring
+#define TRACEWAIT 100   // ticks a read waits for a half-full ring
+
+uint tracemask;  // 1 << type for each type being traced
+
+static struct {
+  struct spinlock lock;  // serializes readers and control
+  struct cpuring ring[NCPU];
+  uint lost[NCPU];       // events dropped since the last TR_LOST
+} tr;
+
+static struct traceevent events[NCPU][NTRACE];
+
+static struct {
+  char *name;
+  uint mask;
+} classes[] = {
+  { "syscall", 1 << TR_SYSCALL | 1 << TR_SYSRET },
+  { "sched",   1 << TR_SWITCH },
+  { "disk",    1 << TR_DISK | 1 << TR_DISKDONE },
+  { "pgflt",   1 << TR_PGFLT },
+  { "commit",  1 << TR_COMMIT },
+  { "all",     ~0 },
+};
+
+// Append an event to this CPU's ring.  Use TRACEPOINT(),
+// which calls this only if the type is enabled.
+void
+trace(int type, uint a, uint b)
+{
+  struct cpuring *r;
+  struct traceevent *e;
+  unsigned long long tsc;
+  int id;
+
+  pushcli();
+  id = cpu - cpus;
+  r = &tr.ring[id];
+  // Keep room for the TR_LOST event as well.
+  if(cpuringlen(r) >= NTRACE - (tr.lost[id] != 0)){
+    tr.lost[id]++;
+    popcli();
+    return;
+  }
+  tsc = rdtsc();
+  if(tr.lost[id]){
+    e = cpuringslot(r);
+    e->tsclo = tsc;
+    e->tschi = tsc >> 32;
+    e->type = TR_LOST;
+    e->cpu = id;
+    e->pid = 0;
+    e->a = tr.lost[id];
+    e->b = 0;
+    cpuringpush(r);
+    tr.lost[id] = 0;
+  }
+  e = cpuringslot(r);
+  e->tsclo = tsc;
+  e->tschi = tsc >> 32;
+  e->type = type;
+  e->cpu = id;
+  e->pid = proc ? proc->pid : 0;
+  e->a = a;
+  e->b = b;
+  cpuringpush(r);
+  popcli();
+}
+
+// Copy out as many whole events as fit in n bytes.
+static int
+traceread(struct inode *ip, char *dst, int n)
+{
+  uint t0;
+  int m;
+
+  iunlock(ip);
+  acquire(&tickslock);
+  t0 = ticks;
+  while(tracemask && !cpuringready(tr.ring, ncpu,
+                                   ticks - t0 >= TRACEWAIT ? 1 : NTRACE/2)){
+    if(proc->killed){
+      release(&tickslock);
+      ilock(ip);
+      return -1;
+    }
+    sleep(&ticks, &tickslock);
+  }
+  release(&tickslock);
+
+  acquire(&tr.lock);
+  m = cpuringread(tr.ring, ncpu, dst, n);
+  release(&tr.lock);
+  ilock(ip);
+  return m;
+}
+
+// Set tracemask from a list of class names, or "off".
+// Turning tracing on empties the rings.
+static int
+tracewrite(struct inode *ip, char *buf, int n)
+{
+  char cmd[64], *p, *q;
+  uint mask;
+  int i, id;
+
+  if(n <= 0 || n >= sizeof(cmd))
+    return -1;
+  memmove(cmd, buf, n);
+  cmd[n] = 0;
+
+  mask = 0;
+  for(p = cmd; *p; p = q){
+    while(*p == ' ' || *p == '\n')
+      p++;
+    for(q = p; *q && *q != ' ' && *q != '\n'; q++)
+      ;
+    if(q == p)
+      break;
+    if(q - p == 3 && strncmp(p, "off", 3) == 0)
+      continue;
+    for(i = 0; i < NELEM(classes); i++)
+      if(strlen(classes[i].name) == q - p &&
+         strncmp(p, classes[i].name, q - p) == 0)
+        break;
+    if(i == NELEM(classes))
+      return -1;
+    mask |= classes[i].mask;
+  }
+
+  iunlock(ip);
+  acquire(&tr.lock);
+  if(tracemask == 0 && mask != 0){
+    for(id = 0; id < NCPU; id++){
+      cpuringclear(&tr.ring[id]);
+      tr.lost[id] = 0;
+    }
+  }
+  tracemask = mask;
+  release(&tr.lock);
+  ilock(ip);
+  return n;
+}
+
+void
+traceinit(void)
+{
+  int id;
+
+  initlock(&tr.lock, "trace");
+  for(id = 0; id < NCPU; id++)
+    cpuringinit(&tr.ring[id], events[id], sizeof(struct traceevent), NTRACE);
+  devsw[TRACE].read = traceread;
+  devsw[TRACE].write = tracewrite;
+}
@@ -0,0 +1,26 @@
+// Kernel trace events, read from the trace device.
+// Write a list of event classes to the device to choose what is
+// traced: "syscall", "sched", "disk", "pgflt", "commit", "all";
+// write "off" to stop.
+
+#define TRACE  3   // device major number
+
+// Event types.
+#define TR_LOST      0   // a events were dropped on this CPU
+#define TR_SYSCALL   1   // a = system call number
+#define TR_SYSRET    2   // a = system call number, b = return value
+#define TR_SWITCH    3   // scheduler switched to pid
+#define TR_DISK      4   // a = block number, b = 1 if a write; issued
+#define TR_DISKDONE  5   // a = block number; done
+#define TR_PGFLT     6   // a = faulting address, b = eip
+#define TR_COMMIT    7   // a = blocks in the transaction
+
+struct traceevent {
+  uint tsclo;        // time-stamp counter
+  uint tschi;
+  ushort type;
+  ushort cpu;
+  int pid;           // current process, or 0
+  uint a;
+  uint b;
+};
@@ -7,10 +7,12 @@
 #include "x86.h"
 #include "traps.h"
 #include "spinlock.h"
+#include "trace.h"
 
 // Interrupt descriptor table (shared by all CPUs).
 struct gatedesc idt[256];
 extern uint vectors[];  // in vectors.S: array of 256 entry pointers
+extern void sysenter_entry(void);  // in trapasm.S
 struct spinlock tickslock;
 uint ticks;
 
@@ -47,12 +49,18 @@ trap(struct trapframe *tf)
     return;
   }
 
-  char *mem;
   switch(tf->trapno){
   case T_IRQ0 + IRQ_TIMER:
+    if(profintr(tf)){
+      // An extra interrupt, just for sampling: return without
+      // yielding, so as not to change the scheduling measured.
+      lapiceoi();
+      return;
+    }
     if(cpunum() == 0){
       acquire(&tickslock);
       ticks++;
+      vdsotick(ticks);
       wakeup(&ticks);
       release(&tickslock);
     }
@@ -106,21 +114,40 @@ trap(struct trapframe *tf)
     lapiceoi();
     break;
   case T_PGFLT:
+    // The vdso pages are present but read-only, so a fault
+    // there is a write; kill the process as for any bad access.
+    if(rcr2() >= VPROC && rcr2() < KERNBASE && (tf->cs&3) == DPL_USER){
+      cprintf("pid %d %s: write to vdso at 0x%x--kill proc\n",
+              proc->pid, proc->name, rcr2());
+      proc->killed = 1;
+      break;
+    }
     // TODO: Check that the PFLA isn't in the guard page below the stack.
-    cprintf("PFLT at: %x\n", rcr2());
-    if ((mem = kalloc()) == 0)
+    TRACEPOINT(TR_PGFLT, rcr2(), tf->eip);
+    // Threads share the page table, and may fault on the
+    // same page or page table at once.
+    vmlock();
+    if(lazyalloc(proc->pgdir, rcr2()) < 0)
       panic("page fault handler OOM\n");
+    vmunlock();
+    break;
 
-    memset(mem, 0, PGSIZE);
-
-    if(mappages(proc->pgdir, (char*)PGROUNDDOWN(rcr2()), PGSIZE, V2P(mem), PTE_W|PTE_U) < 0){
-      kfree(mem);
-      panic("page fault handler OOM (2)\n");
+  case T_DEBUG:
+    // sysenter keeps the user's TF, so a user that single-steps
+    // into it traps at the kernel entry point.  Drop TF and go on.
+    if((tf->cs&3) == 0 && tf->eip == (uint)sysenter_entry){
+      tf->eflags &= ~FL_TF;
+      return;
     }
-    break;
+    // Otherwise, as for any other trap.
+    // fall through
 
   //PAGEBREAK: 13
   default:
+    if(tf->trapno >= T_IRQ0 && virtiointr(tf->trapno - T_IRQ0)){
+      lapiceoi();
+      break;
+    }
     if(proc == 0 || (tf->cs&3) == 0){
       // In kernel, it must be our mistake.
       cprintf("unexpected trap %d from cpu %d eip %x (cr2=0x%x)\n",
@@ -13,16 +13,31 @@
 #include "x86.h"
 
 #define COM1    0x3f8
+#define TXSIZE  512
 
 static int uart;    // is there a uart?
+static int txfifo;  // bytes the transmitter takes at once
+
+// Bytes written by uartwrite, waiting for the transmitter.
+// uartstart moves them to the UART whenever it reports that
+// its transmit holding register (or FIFO) is empty.
+static struct {
+  struct spinlock lock;
+  char buf[TXSIZE];
+  uint r;     // number of bytes sent
+  uint w;     // number of bytes queued
+} tx;
 
 void
 uartinit(void)
 {
   char *p;
 
-  // Turn off the FIFO
-  outb(COM1+2, 0);
+  initlock(&tx.lock, "uart");
+
+  // Turn on and clear the FIFOs, if this is a 16550.
+  outb(COM1+2, 0x07);
+  txfifo = (inb(COM1+2) & 0xC0) == 0xC0 ? 16 : 1;
 
   // 9600 baud, 8 data bits, 1 stop bit, parity off.
   outb(COM1+3, 0x80);    // Unlock divisor
@@ -30,7 +45,7 @@ uartinit(void)
   outb(COM1+1, 0);
   outb(COM1+3, 0x03);    // Lock divisor, 8 data bits.
   outb(COM1+4, 0);
-  outb(COM1+1, 0x01);    // Enable receive interrupts.
+  outb(COM1+1, 0x03);    // Enable receive and transmit interrupts.
 
   // If status is 0xFF, no serial port.
   if(inb(COM1+5) == 0xFF)
@@ -49,6 +64,8 @@ uartinit(void)
     uartputc(*p);
 }
 
+// Write c synchronously, for cprintf and echo, which can
+// run with interrupts off and must not sleep.
 void
 uartputc(int c)
 {
@@ -61,6 +78,49 @@ uartputc(int c)
   outb(COM1+0, c);
 }
 
+// Feed queued bytes to the UART if it can take them.
+// Caller must hold tx.lock.
+static void
+uartstart(void)
+{
+  int i;
+
+  if(tx.r == tx.w || !(inb(COM1+5) & 0x20))
+    return;
+  for(i = 0; i < txfifo && tx.r != tx.w; i++)
+    outb(COM1+0, tx.buf[tx.r++ % TXSIZE]);
+  wakeup(&tx.r);
+}
+
+// Queue n bytes for output and return without waiting for
+// them to be sent, unless the queue is full.  If the process
+// is killed while waiting, return how many bytes were queued,
+// or -1 if none were.
+int
+uartwrite(char *buf, int n)
+{
+  int i;
+
+  if(!uart)
+    return n;
+  acquire(&tx.lock);
+  for(i = 0; i < n; i++){
+    while(tx.w == tx.r + TXSIZE){
+      if(proc == 0 || proc->killed){
+        uartstart();
+        release(&tx.lock);
+        return i > 0 ? i : -1;
+      }
+      uartstart();
+      sleep(&tx.r, &tx.lock);
+    }
+    tx.buf[tx.w++ % TXSIZE] = buf[i];
+  }
+  uartstart();
+  release(&tx.lock);
+  return n;
+}
+
 static int
 uartgetc(void)
 {
@@ -74,5 +134,9 @@ uartgetc(void)
 void
 uartintr(void)
 {
+  inb(COM1+2);  // acknowledge; a transmit interrupt clears on read
   consoleintr(uartgetc);
+  acquire(&tx.lock);
+  uartstart();
+  release(&tx.lock);
 }
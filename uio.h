@@ -0,0 +1,7 @@
+// A buffer for readv() and writev().
+struct iovec {
+  void *base;
+  uint len;
+};
+
+#define IOVMAX 16   // most buffers in one call
@@ -1,8 +1,12 @@
 #include "types.h"
 #include "stat.h"
 #include "fcntl.h"
+#include "ring.h"
 #include "user.h"
 #include "x86.h"
+#include "memlayout.h"
+#include "date.h"
+#include "vdso.h"
 
 char*
 strcpy(char *s, char *t)
@@ -33,10 +37,26 @@ strlen(char *s)
   return n;
 }
 
+// memset and memmove move words with the string instructions,
+// as the kernel's do.
 void*
 memset(void *dst, int c, uint n)
 {
-  stosb(dst, c, n);
+  char *d;
+  uint head;
+
+  c &= 0xFF;
+  d = dst;
+  if(n >= 16){
+    head = -(uint)d & 3;
+    stosb(d, c, head);
+    d += head;
+    n -= head;
+    stosl(d, c * 0x01010101, n/4);
+    d += n & ~3;
+    n &= 3;
+  }
+  stosb(d, c, n);
   return dst;
 }
 
@@ -97,9 +117,136 @@ memmove(void *vdst, void *vsrc, int n)
 {
   char *dst, *src;
 
+  if(n <= 0)
+    return vdst;
   dst = vdst;
   src = vsrc;
-  while(n-- > 0)
-    *dst++ = *src++;
+  if(src < dst && src + n > dst){
+    // Overlapping: copy from the top down.
+    dst += n;
+    src += n;
+    while(n-- > 0)
+      *--dst = *--src;
+  } else {
+    movsl(dst, src, n/4);
+    movsb(dst + (n & ~3), src + (n & ~3), n & 3);
+  }
   return vdst;
 }
+
+// Queue a request on r for the next ring_enter().
+// Returns -1 if the submission ring is full.
+int
+ringput(struct ring *r, int op, int flags, int fd, void *addr, int n, uint data)
+{
+  struct sqe *e;
+
+  if(r->sqtail - r->sqhead == RINGSIZE)
+    return -1;
+  e = &r->sq[r->sqtail % RINGSIZE];
+  e->op = op;
+  e->flags = flags;
+  e->fd = fd;
+  e->addr = addr;
+  e->n = n;
+  e->data = data;
+  r->sqtail++;
+  return 0;
+}
+
+// Take the next completion from r into *c.
+// Returns 0 if there is none.
+int
+ringget(struct ring *r, struct cqe *c)
+{
+  if(r->cqhead == r->cqtail)
+    return 0;
+  *c = r->cq[r->cqhead % RINGSIZE];
+  r->cqhead++;
+  return 1;
+}
+
+// Read the kernel's vdso page (see vdso.h) without a system
+// call.  Retry if the timer interrupt updated it meanwhile.
+static void
+vdsoread(struct vdso *v)
+{
+  struct vdso *k = (struct vdso*)VDSO;
+  uint seq;
+
+  do {
+    while((seq = k->seq) & 1)
+      ;
+    __sync_synchronize();
+    *v = *k;
+    __sync_synchronize();
+  } while(k->seq != seq);
+}
+
+// (hi:lo) / d, for a quotient that fits in 32 bits.  There is
+// no libgcc for 64-bit division, so shift and subtract.
+uint
+div64(uint hi, uint lo, uint d)
+{
+  uint q;
+  int i, carry;
+
+  q = 0;
+  for(i = 0; i < 32; i++){
+    carry = hi >> 31;
+    hi = hi << 1 | lo >> 31;
+    lo <<= 1;
+    q <<= 1;
+    if(carry || hi >= d){
+      hi -= d;
+      q |= 1;
+    }
+  }
+  return q;
+}
+
+// uptime() without a system call.
+int
+vuptime(void)
+{
+  return ((struct vdso*)VDSO)->ticks;
+}
+
+// Microseconds since boot, from the ticks and the time-stamp
+// counter; wraps after about 71 minutes.
+uint
+vmicros(void)
+{
+  struct vdso v;
+  uint d;
+
+  vdsoread(&v);
+  d = (uint)rdtsc() - v.tsclo;
+  if(v.tscperus == 0)
+    d = 0;
+  else
+    d /= v.tscperus;
+  if(d > 10000)   // next tick is late
+    d = 10000;
+  return v.ticks * 10000 + d;
+}
+
+// date() without a system call; the vdso copy is
+// refreshed about once a second.
+int
+vdate(struct rtcdate *r)
+{
+  struct vdso v;
+
+  vdsoread(&v);
+  *r = v.date;
+  return 0;
+}
+
+// The pid of the process that created this address space;
+// clone()d threads share their creator's.
+int
+vgetpid(void)
+{
+  return ((struct vproc*)VPROC)->pid;
+}
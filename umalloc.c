@@ -3,30 +3,98 @@
 #include "user.h"
 #include "param.h"
 
-// Memory allocator by Kernighan and Ritchie,
-// The C programming Language, 2nd ed.  Section 8.7.
+// Memory allocator.
+//
+// Small requests are rounded up to one of NCLASS power-of-two
+// size classes and served from per-thread caches of free
+// blocks, so that the common case is a list pop under an
+// uncontended lock.  A thread's cache is picked by hashing its
+// stack address.  Caches refill from and spill to a central
+// free list per class, which is fed by carving SLABSIZE chunks
+// into blocks.  Slabs are never given back.
+//
+// Larger requests use the allocator by Kernighan and Ritchie,
+// The C programming Language, 2nd ed.  Section 8.7, which
+// coalesces neighbouring free blocks.  A large free block at
+// the top of the heap is returned with a negative sbrk().
 
 typedef long Align;
 
 union header {
   struct {
     union header *ptr;
-    uint size;
+    uint size;      // in units, or size class if < NCLASS
   } s;
   Align x;
 };
 
 typedef union header Header;
 
+#define MINSHIFT  4             // smallest class is 16 bytes
+#define NCLASS    8             // ... and the largest 2048
+#define MAXSMALL  (1 << (MINSHIFT + NCLASS - 1))
+#define NCACHE    8
+#define BATCH     16            // blocks moved cache <-> central
+#define SLABSIZE  16384
+#define TRIMSIZE  (64*1024)     // free this much at top of heap
+#define PAGESIZE  4096
+
+struct lock {
+  volatile uint locked;
+};
+
+struct cache {
+  struct lock lock;
+  Header *free[NCLASS];
+  int nfree[NCLASS];
+};
+
+static struct cache caches[NCACHE];
+
+static struct {
+  struct lock lock;
+  Header *free[NCLASS];
+} central;
+
+static struct lock biglock;     // K&R list and sbrk()
 static Header base;
 static Header *freep;
 
-void
-free(void *ap)
+static inline uint
+xchg(volatile uint *addr, uint newval)
+{
+  uint result;
+
+  asm volatile("lock; xchgl %0, %1" :
+               "+m" (*addr), "=a" (result) :
+               "1" (newval) :
+               "cc");
+  return result;
+}
+
+static void
+lock(struct lock *l)
+{
+  while(xchg(&l->locked, 1) != 0)
+    ;
+}
+
+static void
+unlock(struct lock *l)
+{
+  xchg(&l->locked, 0);
+}
+
+//PAGEBREAK!
+// Large blocks.  biglock must be held.
+
+// Put bp on the free list, coalescing it with its neighbours.
+// Returns the free block that now contains bp.
+static Header*
+bigfree(Header *bp)
 {
-  Header *bp, *p;
+  Header *p;
 
-  bp = (Header*)ap - 1;
   for(p = freep; !(bp > p && bp < p->s.ptr); p = p->s.ptr)
     if(p >= p->s.ptr && (bp > p || bp < p->s.ptr))
       break;
@@ -38,9 +106,28 @@ free(void *ap)
   if(p + p->s.size == bp){
     p->s.size += bp->s.size;
     p->s.ptr = bp->s.ptr;
+    bp = p;
   } else
     p->s.ptr = bp;
   freep = p;
+  return bp;
+}
+
+// If free block bp is large and at the top of the heap, give
+// its whole pages back, keeping its header so that the free
+// list needn't be relinked.
+static void
+trim(Header *bp)
+{
+  uint cut;
+
+  if(bp->s.size * sizeof(Header) >= TRIMSIZE &&
+     (char*)(bp + bp->s.size) == sbrk(0)){
+    cut = (bp->s.size - 1) * sizeof(Header) & ~(PAGESIZE-1);
+    // Fails while threads share our memory; keep it then.
+    if(sbrk(-cut) != (char*)-1)
+      bp->s.size -= cut / sizeof(Header);
+  }
 }
 
 static Header*
@@ -51,17 +138,19 @@ morecore(uint nu)
 
   if(nu < 4096)
     nu = 4096;
+  if(nu >= 0x10000000)
+    return 0;
   p = sbrk(nu * sizeof(Header));
   if(p == (char*)-1)
     return 0;
   hp = (Header*)p;
   hp->s.size = nu;
-  free((void*)(hp + 1));
+  bigfree(hp);
   return freep;
 }
 
-void*
-malloc(uint nbytes)
+static Header*
+bigalloc(uint nbytes)
 {
   Header *p, *prevp;
   uint nunits;
@@ -81,10 +170,142 @@ malloc(uint nbytes)
         p->s.size = nunits;
       }
       freep = prevp;
-      return (void*)(p + 1);
+      return p;
     }
     if(p == freep)
       if((p = morecore(nunits)) == 0)
         return 0;
   }
 }
+
+//PAGEBREAK!
+// Small blocks.
+
+static int
+sizeclass(uint n)
+{
+  int c;
+
+  for(c = 0; (1 << (MINSHIFT + c)) < n; c++)
+    ;
+  return c;
+}
+
+static struct cache*
+mycache(void)
+{
+  uint sp;
+
+  asm volatile("movl %%esp, %0" : "=r" (sp));
+  return &caches[((sp >> 12) ^ (sp >> 15)) % NCACHE];
+}
+
+// Move up to BATCH blocks of class c from the central list
+// to cache ca, carving a new slab if the list is empty.
+// ca must be locked.
+static int
+refill(struct cache *ca, int c)
+{
+  Header *h, *slab;
+  uint sz;
+  int i;
+
+  lock(&central.lock);
+  if(central.free[c] == 0){
+    lock(&biglock);
+    slab = bigalloc(SLABSIZE);
+    unlock(&biglock);
+    if(slab == 0){
+      unlock(&central.lock);
+      return -1;
+    }
+    sz = 1 << (MINSHIFT + c);
+    for(i = SLABSIZE / sz - 1; i >= 0; i--){
+      h = (Header*)((char*)(slab + 1) + i*sz);
+      h->s.ptr = central.free[c];
+      central.free[c] = h;
+    }
+  }
+  for(i = 0; i < BATCH && central.free[c]; i++){
+    h = central.free[c];
+    central.free[c] = h->s.ptr;
+    h->s.ptr = ca->free[c];
+    ca->free[c] = h;
+    ca->nfree[c]++;
+  }
+  unlock(&central.lock);
+  return 0;
+}
+
+// Move BATCH blocks of class c from cache ca to the central
+// list.  ca must be locked.
+static void
+spill(struct cache *ca, int c)
+{
+  Header *h;
+  int i;
+
+  lock(&central.lock);
+  for(i = 0; i < BATCH; i++){
+    h = ca->free[c];
+    ca->free[c] = h->s.ptr;
+    ca->nfree[c]--;
+    h->s.ptr = central.free[c];
+    central.free[c] = h;
+  }
+  unlock(&central.lock);
+}
+
+void
+free(void *ap)
+{
+  Header *h;
+  struct cache *ca;
+  int c;
+
+  if(ap == 0)
+    return;
+  h = (Header*)ap - 1;
+  if(h->s.size >= NCLASS){
+    lock(&biglock);
+    trim(bigfree(h));
+    unlock(&biglock);
+    return;
+  }
+  c = h->s.size;
+  ca = mycache();
+  lock(&ca->lock);
+  h->s.ptr = ca->free[c];
+  ca->free[c] = h;
+  if(++ca->nfree[c] > 2*BATCH)
+    spill(ca, c);
+  unlock(&ca->lock);
+}
+
+void*
+malloc(uint nbytes)
+{
+  Header *h;
+  struct cache *ca;
+  int c;
+
+  if(nbytes > MAXSMALL - sizeof(Header)){
+    lock(&biglock);
+    h = bigalloc(nbytes);
+    unlock(&biglock);
+    return h ? (void*)(h + 1) : 0;
+  }
+  c = sizeclass(nbytes + sizeof(Header));
+  ca = mycache();
+  lock(&ca->lock);
+  if(ca->free[c] == 0 && refill(ca, c) < 0){
+    unlock(&ca->lock);
+    return 0;
+  }
+  h = ca->free[c];
+  ca->free[c] = h->s.ptr;
+  ca->nfree[c]--;
+  unlock(&ca->lock);
+  h->s.size = c;
+  return (void*)(h + 1);
+}
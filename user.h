@@ -1,15 +1,31 @@
 struct stat;
 struct rtcdate;
+struct ring;
+struct cqe;
+struct iovec;
+struct lockstat;
+struct sysstat;
 
 // system calls
 int alarm(int, void (*)(void));
+int clone(void (*)(void*), void*, void*);
 int date(struct rtcdate*);
 int fork(void);
+int futexwait(int*, int);
+int futexwake(int*, int);
 int exit(void) __attribute__((noreturn));
 int wait(void);
 int pipe(int*);
 int write(int, void*, int);
 int read(int, void*, int);
+int readv(int, struct iovec*, int);
+int writev(int, struct iovec*, int);
+int pread(int, void*, int, int);
+int pwrite(int, void*, int, int);
+int fsync(int);
+int sync(void);
+int lockstat(struct lockstat*, int);
+int sysstat(struct sysstat*, int);
 int close(int);
 int kill(int);
 int exec(char*, char**);
@@ -21,11 +37,21 @@ int link(char*, char*);
 int mkdir(char*);
 int chdir(char*);
 int dup(int);
+int eventfd(int, int);
 int getpid(void);
+int join(void**);
+int ring_enter(struct ring*);
 char* sbrk(int);
+char* shmbrk(int);
 int sleep(int);
 int uptime(void);
 
+// system calls through sysenter (usys.S)
+int fastgetpid(void);
+int fastread(int, void*, int);
+int fastwrite(int, void*, int);
+int fastuptime(void);
+
 // ulib.c
 int stat(char*, struct stat*);
 char* strcpy(char*, char*);
@@ -39,3 +65,10 @@ void* memset(void*, int, uint);
 void* malloc(uint);
 void free(void*);
 int atoi(const char*);
+int ringput(struct ring*, int, int, int, void*, int, uint);
+int ringget(struct ring*, struct cqe*);
+int vuptime(void);
+uint vmicros(void);
+uint div64(uint, uint, uint);
+int vdate(struct rtcdate*);
+int vgetpid(void);
@@ -7,6 +7,9 @@
 #include "syscall.h"
 #include "traps.h"
 #include "memlayout.h"
+#include "ring.h"
+#include "date.h"
+#include "uio.h"
 
 char buf[8192];
 char name[3];
@@ -184,6 +187,10 @@ writetest(void)
   printf(stdout, "small file test ok\n");
 }
 
+// 512-byte writes to reach a few blocks into the
+// double-indirect range.
+#define BIGFILE ((NDIRECT+NINDIRECT+8) * (BSIZE/512))
+
 void
 writetest1(void)
 {
@@ -197,7 +204,7 @@ writetest1(void)
     exit();
   }
 
-  for(i = 0; i < MAXFILE; i++){
+  for(i = 0; i < BIGFILE; i++){
     ((int*)buf)[0] = i;
     if(write(fd, buf, 512) != 512){
       printf(stdout, "error: write big file failed\n", i);
@@ -217,7 +224,7 @@ writetest1(void)
   for(;;){
     i = read(fd, buf, 512);
     if(i == 0){
-      if(n == MAXFILE - 1){
+      if(n != BIGFILE){
         printf(stdout, "read only %d blocks from big", n);
         exit();
       }
@@ -354,6 +361,436 @@ pipe1(void)
   printf(1, "pipe1 ok\n");
 }
 
+// eventfd counters and semaphores across fork
+void
+eventfdtest(void)
+{
+  int fd, pid, i, v;
+
+  printf(1, "eventfd test\n");
+  fd = eventfd(0, EFD_SEMAPHORE);
+  if(fd < 0){
+    printf(1, "eventfd() failed\n");
+    exit();
+  }
+  pid = fork();
+  if(pid < 0){
+    printf(1, "fork() failed\n");
+    exit();
+  }
+  if(pid == 0){
+    for(i = 0; i < 10; i++){
+      v = 1;
+      if(write(fd, &v, sizeof(v)) != sizeof(v)){
+        printf(1, "eventfd write failed\n");
+        exit();
+      }
+    }
+    exit();
+  }
+  for(i = 0; i < 10; i++){
+    if(read(fd, &v, sizeof(v)) != sizeof(v) || v != 1){
+      printf(1, "eventfd semaphore read failed\n");
+      exit();
+    }
+  }
+  wait();
+  close(fd);
+
+  fd = eventfd(5, EFD_NONBLOCK);
+  v = 7;
+  if(fd < 0 || write(fd, &v, sizeof(v)) != sizeof(v)){
+    printf(1, "eventfd counter write failed\n");
+    exit();
+  }
+  if(read(fd, &v, sizeof(v)) != sizeof(v) || v != 12){
+    printf(1, "eventfd counter read wrong value\n");
+    exit();
+  }
+  if(read(fd, &v, sizeof(v)) != -1){
+    printf(1, "eventfd nonblocking read of 0 succeeded\n");
+    exit();
+  }
+  close(fd);
+  printf(1, "eventfd ok\n");
+}
+
+// batched open/write/fstat/close/read with ring_enter()
+void
+ringtest(void)
+{
+  static struct ring r;
+  struct stat st;
+  struct cqe c;
+  int i, res[6];
+
+  printf(1, "ring test\n");
+  ringput(&r, RING_OPEN, 0, 0, "ringfile", O_CREATE|O_RDWR, 0);
+  ringput(&r, RING_WRITE, RING_LINK, 0, "hello", 5, 1);
+  ringput(&r, RING_FSTAT, RING_LINK, 0, &st, 0, 2);
+  ringput(&r, RING_CLOSE, RING_LINK, 0, 0, 0, 3);
+  ringput(&r, RING_OPEN, 0, 0, "ringfile", O_RDONLY, 4);
+  ringput(&r, RING_READ, RING_LINK, 0, buf, sizeof(buf), 5);
+  if(ring_enter(&r) != 6){
+    printf(1, "ring_enter did not run the batch\n");
+    exit();
+  }
+  for(i = 0; i < 6; i++){
+    if(!ringget(&r, &c) || c.data != i){
+      printf(1, "ring completion %d missing\n", i);
+      exit();
+    }
+    res[i] = c.res;
+  }
+  buf[5] = 0;
+  if(res[0] < 0 || res[1] != 5 || res[2] != 0 || st.size != 5 ||
+     res[3] != 0 || res[4] < 0 || res[5] != 5 || strcmp(buf, "hello")){
+    printf(1, "ring results wrong\n");
+    exit();
+  }
+  close(res[4]);
+  if(ring_enter(&r) != 0){
+    printf(1, "ring_enter ran an empty ring\n");
+    exit();
+  }
+  unlink("ringfile");
+  printf(1, "ring ok\n");
+}
+
+// do the vdso readers agree with the system calls?
+void
+vdsotest(void)
+{
+  struct rtcdate d1, d2;
+  int t, pid;
+  uint us;
+
+  printf(1, "vdso test\n");
+  if(vgetpid() != getpid()){
+    printf(1, "vgetpid wrong\n");
+    exit();
+  }
+  t = uptime();
+  if(vuptime() < t || vuptime() > t + 5){
+    printf(1, "vuptime wrong\n");
+    exit();
+  }
+  date(&d1);
+  vdate(&d2);
+  if(d1.year != d2.year || d1.month != d2.month){
+    printf(1, "vdate wrong\n");
+    exit();
+  }
+  us = vmicros();
+  sleep(2);
+  if(vmicros() - us < 10000){
+    printf(1, "vmicros did not advance\n");
+    exit();
+  }
+  pid = fork();
+  if(pid == 0){
+    if(vgetpid() != getpid())
+      printf(1, "vgetpid wrong in child\n");
+    *(int*)VDSO = 0;
+    printf(1, "vdso is writable\n");
+    exit();
+  }
+  wait();
+  printf(1, "vdso ok\n");
+}
+
+// readv/writev gather and scatter in order; pread/pwrite
+// use their own offset and leave the file offset alone.
+void
+uiotest(void)
+{
+  struct iovec iov[3];
+  char a[4], b[8], c[16];
+  int fd;
+
+  printf(1, "uio test\n");
+  unlink("uio");
+  fd = open("uio", O_CREATE|O_RDWR);
+  if(fd < 0){
+    printf(1, "open uio failed\n");
+    exit();
+  }
+  iov[0].base = "abc";
+  iov[0].len = 3;
+  iov[1].base = "defgh";
+  iov[1].len = 5;
+  iov[2].base = "ij";
+  iov[2].len = 2;
+  if(writev(fd, iov, 3) != 10){
+    printf(1, "writev failed\n");
+    exit();
+  }
+  if(pwrite(fd, "XY", 2, 3) != 2 || write(fd, "k", 1) != 1){
+    printf(1, "pwrite failed\n");
+    exit();
+  }
+  memset(c, 0, sizeof(c));
+  if(pread(fd, c, sizeof(c), 0) != 11 || strcmp(c, "abcXYfghijk") != 0){
+    printf(1, "pread wrong: %s\n", c);
+    exit();
+  }
+  close(fd);
+
+  fd = open("uio", O_RDONLY);
+  memset(a, 0, sizeof(a));
+  memset(b, 0, sizeof(b));
+  memset(c, 0, sizeof(c));
+  iov[0].base = a;
+  iov[0].len = 3;
+  iov[1].base = b;
+  iov[1].len = 7;
+  iov[2].base = c;
+  iov[2].len = 15;
+  if(readv(fd, iov, 3) != 11 || strcmp(a, "abc") != 0 ||
+     strcmp(b, "XYfghij") != 0 || strcmp(c, "k") != 0){
+    printf(1, "readv wrong\n");
+    exit();
+  }
+  if(readv(fd, iov, IOVMAX+1) != -1 || pread(fd, c, 1, -1) != -1){
+    printf(1, "uio bad args succeeded\n");
+    exit();
+  }
+  close(fd);
+  unlink("uio");
+  printf(1, "uio ok\n");
+}
+
+// fsync, sync and O_SYNC force commits; the data must
+// read back the same either way.
+void
+synctest(void)
+{
+  char buf[8];
+  int fd, fds[2];
+
+  printf(1, "sync test\n");
+  fd = open("synced", O_CREATE|O_RDWR|O_SYNC);
+  if(fd < 0 || write(fd, "abc", 3) != 3){
+    printf(1, "O_SYNC write failed\n");
+    exit();
+  }
+  close(fd);
+  fd = open("synced", O_RDWR);
+  if(fd < 0 || pwrite(fd, "de", 2, 3) != 2 || fsync(fd) != 0){
+    printf(1, "fsync failed\n");
+    exit();
+  }
+  memset(buf, 0, sizeof(buf));
+  if(pread(fd, buf, sizeof(buf), 0) != 5 || strcmp(buf, "abcde") != 0){
+    printf(1, "synced data wrong\n");
+    exit();
+  }
+  close(fd);
+  if(unlink("synced") < 0 || sync() != 0){
+    printf(1, "sync failed\n");
+    exit();
+  }
+  pipe(fds);
+  if(fsync(fds[0]) != -1){
+    printf(1, "fsync of a pipe succeeded\n");
+    exit();
+  }
+  close(fds[0]);
+  close(fds[1]);
+  printf(1, "sync ok\n");
+}
+
+// Several processes read one file and look up its path at
+// once; they share the inode locks and must see the same data.
+void
+sharedreadtest(void)
+{
+  struct stat st;
+  char buf[64];
+  int fd, i, j, k, pid;
+
+  printf(1, "shared read test\n");
+  fd = open("shared", O_CREATE|O_WRONLY);
+  for(i = 0; i < sizeof(buf); i++)
+    buf[i] = i;
+  for(i = 0; i < 64; i++)
+    write(fd, buf, sizeof(buf));
+  close(fd);
+
+  for(k = 0; k < 4; k++){
+    pid = fork();
+    if(pid < 0){
+      printf(1, "fork failed\n");
+      exit();
+    }
+    if(pid == 0){
+      for(j = 0; j < 10; j++){
+        fd = open("shared", O_RDONLY);
+        if(fd < 0 || fstat(fd, &st) < 0 || st.size != 64*sizeof(buf)){
+          printf(1, "shared open/fstat failed\n");
+          exit();
+        }
+        while((i = read(fd, buf, sizeof(buf))) > 0){
+          for(i = 0; i < sizeof(buf); i++){
+            if(buf[i] != i){
+              printf(1, "shared read wrong data\n");
+              exit();
+            }
+          }
+        }
+        close(fd);
+      }
+      exit();
+    }
+  }
+  for(k = 0; k < 4; k++)
+    wait();
+  unlink("shared");
+  printf(1, "shared read ok\n");
+}
+
+// Hold more open pipes at once than the old fixed file
+// table (100 entries) had room for.
+void
+manypipes(void)
+{
+  int ready[2], hold[2], fds[2];
+  int i, k, pid;
+  char c;
+
+  printf(1, "many pipes test\n");
+  if(pipe(ready) < 0 || pipe(hold) < 0){
+    printf(1, "pipe() failed\n");
+    exit();
+  }
+  for(k = 0; k < 12; k++){
+    pid = fork();
+    if(pid < 0){
+      printf(1, "fork failed\n");
+      exit();
+    }
+    if(pid == 0){
+      close(ready[0]);
+      close(hold[1]);
+      c = 'x';
+      for(i = 0; i < 5; i++)
+        if(pipe(fds) < 0)
+          c = 'n';
+      write(ready[1], &c, 1);
+      read(hold[0], &c, 1);  // until the parent closes hold[1]
+      exit();
+    }
+  }
+  close(ready[1]);
+  close(hold[0]);
+  for(k = 0; k < 12; k++){
+    if(read(ready[0], &c, 1) != 1 || c != 'x'){
+      printf(1, "many pipes: pipe() failed\n");
+      exit();
+    }
+  }
+  close(hold[1]);
+  close(ready[0]);
+  for(k = 0; k < 12; k++)
+    wait();
+  printf(1, "many pipes ok\n");
+}
+
+// Enter the kernel through sysenter with the trap and
+// alignment-check flags set; the kernel must not take the
+// user's flags for its own.
+void
+sysenterflags(void)
+{
+  int pid, ret;
+
+  printf(1, "sysenter flags test\n");
+  pid = fork();
+  if(pid < 0){
+    printf(1, "fork failed\n");
+    exit();
+  }
+  if(pid == 0){
+    // popfl must come right before sysenter, or the single
+    // step traps in user space first.
+    asm volatile("movl %%esp, %%ecx\n\t"
+                 "movl $1f, %%edx\n\t"
+                 "pushfl\n\t"
+                 "orl $0x40100, (%%esp)\n\t"  // AC | TF
+                 "popfl\n\t"
+                 "sysenter\n"
+                 "1:\n\t"
+                 "pushfl\n\t"
+                 "andl $~0x40100, (%%esp)\n\t"
+                 "popfl" :
+                 "=a" (ret) :
+                 "a" (SYS_getpid) :
+                 "ecx", "edx", "memory", "cc");
+    if(ret != getpid())
+      printf(1, "sysenter flags: getpid returned %d\n", ret);
+    exit();
+  }
+  wait();
+  printf(1, "sysenter flags ok\n");
+}
+
+// Hold thousands of descriptors, and check that the
+// lowest free one is always handed out.
+void
+manyfds(void)
+{
+  int fd, i, n, pid;
+
+  printf(1, "many fds test\n");
+  fd = open("manyfds", O_CREATE|O_RDWR);
+  if(fd < 0){
+    printf(1, "open manyfds failed\n");
+    exit();
+  }
+  n = 2000;
+  for(i = fd+1; i < n; i++){
+    // Alternate new files with duplicates of old ones.
+    if(i % 2)
+      fd = open("manyfds", O_RDONLY);
+    else
+      fd = dup(i - 1);
+    if(fd != i){
+      printf(1, "many fds: got fd %d, wanted %d\n", fd, i);
+      exit();
+    }
+  }
+  close(100);
+  close(1500);
+  if(dup(0) != 100 || dup(0) != 1500 || dup(0) != n){
+    printf(1, "many fds: not the lowest free fd\n");
+    exit();
+  }
+
+  pid = fork();
+  if(pid < 0){
+    printf(1, "fork failed\n");
+    exit();
+  }
+  if(pid == 0){
+    for(i = 3; i <= n; i++){
+      if(close(i) < 0){
+        printf(1, "many fds: fd %d not inherited\n", i);
+        exit();
+      }
+    }
+    exit();
+  }
+  wait();
+  for(i = 3; i <= n; i++)
+    close(i);
+  if(close(n) == 0){
+    printf(1, "many fds: closed fd twice\n");
+    exit();
+  }
+  unlink("manyfds");
+  printf(1, "many fds ok\n");
+}
+
 // meant to be run w/ at most two CPUs
 void
 preempt(void)
@@ -1347,7 +1784,7 @@ iref(void)
 
   printf(1, "empty file name\n");
 
-  // the 50 is NINODE
+  // the 50 was the size of the old fixed inode cache
   for(i = 0; i < 50 + 1; i++){
     if(mkdir("irefd") != 0){
       printf(1, "mkdir irefd failed\n");
@@ -1546,6 +1983,158 @@ sbrktest(void)
   printf(stdout, "sbrk test OK\n");
 }
 
+// do children share, rather than copy, pages from shmbrk()?
+void
+shmtest(void)
+{
+  char *a, *b;
+  int fds[2], i, pid;
+  char c;
+
+  printf(stdout, "shm test\n");
+  a = shmbrk(0);
+  if(shmbrk(3*4096) != a || shmbrk(0) != a + 3*4096){
+    printf(stdout, "shmbrk failed\n");
+    exit();
+  }
+  for(i = 0; i < 3*4096; i++){
+    if(a[i] != 0){
+      printf(stdout, "shm not zeroed\n");
+      exit();
+    }
+  }
+  if(pipe(fds) != 0){
+    printf(stdout, "pipe() failed\n");
+    exit();
+  }
+  pid = fork();
+  if(pid < 0){
+    printf(stdout, "fork failed\n");
+    exit();
+  }
+  if(pid == 0){
+    for(i = 0; i < 3*4096; i++)
+      a[i] = i % 251;
+    // syscalls accept pointers into the shared segment
+    if(write(fds[1], a + 4096, 1) != 1){
+      printf(stdout, "write from shm failed\n");
+      exit();
+    }
+    exit();
+  }
+  if(read(fds[0], &c, 1) != 1 || c != 4096 % 251){
+    printf(stdout, "read of shm byte failed\n");
+    exit();
+  }
+  wait();
+  close(fds[0]);
+  close(fds[1]);
+  for(i = 0; i < 3*4096; i++){
+    if(a[i] != (char)(i % 251)){
+      printf(stdout, "shm not shared at %d\n", i);
+      exit();
+    }
+  }
+
+  // the parent's private memory is still copied
+  b = buf;
+  b[0] = 'p';
+  pid = fork();
+  if(pid == 0){
+    b[0] = 'c';
+    exit();
+  }
+  wait();
+  if(b[0] != 'p'){
+    printf(stdout, "fork shared private memory\n");
+    exit();
+  }
+
+  if(shmbrk(-3*4096) != a + 3*4096 || shmbrk(0) != a){
+    printf(stdout, "shmbrk shrink failed\n");
+    exit();
+  }
+  printf(stdout, "shm test OK\n");
+}
+
+#define NCLONE 4
+volatile int clonesum[NCLONE];
+int clonegate;
+
+void
+clonethread(void *arg)
+{
+  int i, n;
+
+  n = (int)arg;
+  if(n == 0){
+    // block until main opens the gate
+    while(clonegate == 0)
+      futexwait(&clonegate, 0);
+  }
+  for(i = 0; i <= 1000; i++)
+    clonesum[n] += i;
+  exit();
+}
+
+// do clone()d threads share memory, and do join() and
+// the futex calls work?
+void
+clonetest(void)
+{
+  void *stacks[NCLONE], *stack;
+  int i, j, pids[NCLONE], pid;
+
+  printf(stdout, "clone test\n");
+  clonegate = 0;
+  for(i = 0; i < NCLONE; i++){
+    clonesum[i] = 0;
+    stacks[i] = malloc(4096);
+    if((pids[i] = clone(clonethread, (void*)i, stacks[i])) < 0){
+      printf(stdout, "clone failed\n");
+      exit();
+    }
+  }
+  // thread 0 cannot finish until the gate opens
+  for(i = 0; i < 100; i++){
+    if(clonesum[0] != 0){
+      printf(stdout, "futexwait did not block\n");
+      exit();
+    }
+    sleep(0);
+  }
+  clonegate = 1;
+  futexwake(&clonegate, 1);
+
+  for(i = 0; i < NCLONE; i++){
+    if((pid = join(&stack)) < 0){
+      printf(stdout, "join failed\n");
+      exit();
+    }
+    for(j = 0; j < NCLONE; j++)
+      if(pids[j] == pid && stacks[j] != stack){
+        printf(stdout, "join returned wrong stack\n");
+        exit();
+      }
+    free(stack);
+  }
+  if(join(&stack) != -1){
+    printf(stdout, "join got too many\n");
+    exit();
+  }
+  if(wait() != -1){
+    printf(stdout, "wait reaped a thread\n");
+    exit();
+  }
+  for(i = 0; i < NCLONE; i++){
+    if(clonesum[i] != 500500){
+      printf(stdout, "thread %d did not share memory\n", i);
+      exit();
+    }
+  }
+  printf(stdout, "clone test OK\n");
+}
+
 void
 validateint(int *p)
 {
@@ -1745,6 +2334,114 @@ rand()
   return randstate;
 }
 
+// malloc benchmark: alloc/free churn in one and then several
+// threads, and fragmentation and give-back of large blocks.
+#define NSLOT 128
+#define NBIG 64
+int mbfail;
+
+// Randomly allocate and free blocks, mostly small, checking
+// that no block is handed out twice.  Returns -1 on error.
+int
+mbchurn(uint seed, int nops)
+{
+  char *slot[NSLOT];
+  uint sz[NSLOT];
+  int i, r;
+
+  memset(slot, 0, sizeof(slot));
+  r = 0;
+  while(nops-- > 0){
+    seed = seed * 1664525 + 1013904223;
+    i = (seed >> 8) % NSLOT;
+    if(slot[i]){
+      if(slot[i][0] != (char)i || slot[i][sz[i]-1] != (char)i)
+        r = -1;
+      free(slot[i]);
+      slot[i] = 0;
+      continue;
+    }
+    sz[i] = (seed >> 16) % 8 == 0 ? 4000 + (seed >> 20) % 16000 :
+                                    1 + (seed >> 20) % 500;
+    if((slot[i] = malloc(sz[i])) == 0)
+      return -1;
+    slot[i][0] = slot[i][sz[i]-1] = i;
+  }
+  for(i = 0; i < NSLOT; i++)
+    free(slot[i]);
+  return r;
+}
+
+void
+mbthread(void *arg)
+{
+  if(mbchurn((uint)arg, 20000) < 0)
+    mbfail = 1;
+  exit();
+}
+
+void
+mallocbench(void)
+{
+  char *big[NBIG], *top0, *peak;
+  void *stack;
+  int i, t0;
+
+  printf(1, "malloc bench\n");
+
+  // Free every other block, then ask for bigger ones that
+  // don't fit the holes until neighbours are coalesced.
+  top0 = sbrk(0);
+  for(i = 0; i < NBIG; i++)
+    big[i] = malloc(8192 + i*64);
+  for(i = 0; i < NBIG; i += 2)
+    free(big[i]);
+  for(i = 1; i < NBIG; i += 2){
+    free(big[i]);
+    big[i] = malloc(16384);
+    if(big[i] == 0){
+      printf(1, "malloc failed\n");
+      exit();
+    }
+  }
+  peak = sbrk(0);
+  for(i = 1; i < NBIG; i += 2)
+    free(big[i]);
+  printf(1, "heap grew %d KB; %d KB left after free\n",
+         (peak - top0) / 1024, (sbrk(0) - top0) / 1024);
+  if(sbrk(0) >= peak){
+    printf(1, "free did not shrink the heap\n");
+    exit();
+  }
+
+  t0 = uptime();
+  if(mbchurn(1, 50000) < 0){
+    printf(1, "malloc churn failed\n");
+    exit();
+  }
+  printf(1, "churn: 50000 ops in %d ticks\n", uptime() - t0);
+
+  mbfail = 0;
+  t0 = uptime();
+  for(i = 0; i < NCLONE; i++){
+    if(clone(mbthread, (void*)(i + 1), malloc(4096)) < 0){
+      printf(1, "clone failed\n");
+      exit();
+    }
+  }
+  for(i = 0; i < NCLONE; i++){
+    join(&stack);
+    free(stack);
+  }
+  if(mbfail){
+    printf(1, "threaded malloc churn failed\n");
+    exit();
+  }
+  printf(1, "churn: %d threads x 20000 ops in %d ticks\n",
+         NCLONE, uptime() - t0);
+  printf(1, "malloc bench ok\n");
+}
+
 int
 main(int argc, char *argv[])
 {
@@ -1768,6 +2465,9 @@ main(int argc, char *argv[])
   bigargtest();
   bsstest();
   sbrktest();
+  shmtest();
+  clonetest();
+  mallocbench();
   validatetest();
 
   opentest();
@@ -1781,6 +2481,15 @@ main(int argc, char *argv[])
 
   mem();
   pipe1();
+  eventfdtest();
+  ringtest();
+  vdsotest();
+  uiotest();
+  synctest();
+  sharedreadtest();
+  manypipes();
+  manyfds();
+  sysenterflags();
   preempt();
   exitwait();
 
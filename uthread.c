@@ -1,123 +1,333 @@
+// User-level threads.
+//
+// Threads run on workers: main() plus up to MAX_WORKER-1
+// clone()d kernel threads, so that threads can use several
+// CPUs.  Runnable threads wait on one FIFO run queue.  A worker
+// takes the thread at the head and switches to it; the thread
+// switches back when it yields, exits or is preempted, and only
+// then does the worker requeue (or free) it, so no other worker
+// can pick up a thread whose registers are still being saved.
+//
+// Preemption uses alarm(): every quantum ticks each worker gets
+// an upcall to thread_alarm (uthread_switch.S), which yields on
+// behalf of the interrupted thread.  A thread sets its nopreempt
+// flag around switches and while holding library locks, and the
+// upcall leaves such threads alone.
+//
+// A thread's struct sits at the bottom of its STACK_SIZE-aligned
+// stack, so thread_self() just masks %esp.
+
 #include "types.h"
 #include "stat.h"
 #include "user.h"
+#include "uthread.h"
 
-/* Possible states of a thread; */
-#define FREE        0x0
-#define RUNNING     0x1
-#define RUNNABLE    0x2
-
-#define STACK_SIZE  8192
-#define MAX_THREAD  4
+#define RUNNABLE    0x1
+#define RUNNING     0x2
+#define ZOMBIE      0x3
 
-typedef struct thread thread_t, *thread_p;
-typedef struct mutex mutex_t, *mutex_p;
+struct lock {
+  volatile uint locked;
+};
 
-struct thread {
-  int        sp;                /* current stack pointer */
-  char stack[STACK_SIZE];       /* the thread's stack */
-  int        state;             /* FREE, RUNNING, RUNNABLE */
+struct worker {
+  int pid;
+  int sp;                   // saved scheduler stack pointer
+  struct thread *current;   // thread running on this worker, or 0
+  char *stack;              // clone() stack, 0 for main
 };
-extern void thread_switch(void);
 
-// These end up in the .bss segment of the binary
-static thread_t all_thread[MAX_THREAD];
-thread_p  current_thread;
-thread_p  next_thread;
+static struct {
+  struct lock lock;
+  struct thread *head;
+  struct thread *tail;
+  int nthread;    // created and not yet freed
+  int nidle;      // workers waiting for work
+  int seq;        // futex word; bumped when work arrives
+} runq;
+
+static struct worker workers[MAX_WORKER];
+static int nworker = 1;
+static int quantum;
+static int started;
+static int nextid;
+
+extern void thread_switch(int *oldsp, int newsp);
+extern void thread_alarm(void);
+void thread_preempt(void);
+
+static inline uint
+xchg(volatile uint *addr, uint newval)
+{
+  uint result;
+
+  asm volatile("lock; xchgl %0, %1" :
+               "+m" (*addr), "=a" (result) :
+               "1" (newval) :
+               "cc");
+  return result;
+}
+
+static void
+lock(struct lock *l)
+{
+  while(xchg(&l->locked, 1) != 0)
+    ;
+}
+
+static void
+unlock(struct lock *l)
+{
+  xchg(&l->locked, 0);
+}
+
+struct thread*
+thread_self(void)
+{
+  uint sp;
+
+  asm volatile("movl %%esp, %0" : "=r" (sp));
+  return (struct thread*)(sp & ~(STACK_SIZE-1));
+}
 
+// Use nworker workers, and preempt threads every quantum
+// ticks; a quantum of 0 means threads must yield.
+// Call before thread_run().
 void
-thread_init(void)
+thread_init(int n, int q)
 {
-  // main() is thread 0, which will make the first invocation to
-  // thread_schedule().  it needs a stack so that the first thread_switch() can
-  // save thread 0's state.  thread_schedule() won't run the main thread ever
-  // again, because its state is set to RUNNING, and thread_schedule() selects
-  // a RUNNABLE thread.
-  current_thread = &all_thread[0];
-  current_thread->state = RUNNING;
+  if(n < 1)
+    n = 1;
+  if(n > MAX_WORKER)
+    n = MAX_WORKER;
+  nworker = n;
+  quantum = q;
 }
 
 static void
-thread_schedule(void)
+enqueue(struct thread *t)
 {
-  thread_p t;
+  int idle;
 
-  /* Find the next runnable thread. */
-  next_thread = 0;
-  for (t = all_thread; t < all_thread + MAX_THREAD; t++) {
-    if (t->state == RUNNABLE && t != current_thread) {
-      next_thread = t;
-      break;
-    }
-  }
+  lock(&runq.lock);
+  t->next = 0;
+  if(runq.tail)
+    runq.tail->next = t;
+  else
+    runq.head = t;
+  runq.tail = t;
+  runq.seq++;
+  idle = runq.nidle;
+  unlock(&runq.lock);
+  if(idle)
+    futexwake(&runq.seq, 1);
+}
 
-  if (t >= all_thread + MAX_THREAD && current_thread->state == RUNNABLE) {
-    /* The current thread is the only runnable thread; run it. */
-    next_thread = current_thread;
-  }
+// First code run by a new thread, entered from thread_switch.
+static void
+thread_start(void)
+{
+  struct thread *t;
+
+  t = thread_self();
+  t->nopreempt = 0;
+  t->fn(t->arg);
+  thread_exit();
+}
+
+// Create a thread running fn(arg); returns its id.
+int
+thread_create(void (*fn)(void*), void *arg)
+{
+  struct thread *self, *t;
+  char *mem;
+  int *sp, id;
+
+  if((mem = malloc(2*STACK_SIZE)) == 0)
+    return -1;
+
+  t = (struct thread*)(((uint)mem + STACK_SIZE-1) & ~(STACK_SIZE-1));
+  memset(t, 0, sizeof(*t));
+  t->mem = mem;
+  t->fn = fn;
+  t->arg = arg;
+  t->state = RUNNABLE;
+  t->nopreempt = 1;
 
-  if (next_thread == 0) {
-    printf(2, "thread_schedule: no runnable threads\n");
-    exit();
+  // Build the frame that thread_switch pops: four callee-saved
+  // registers, then thread_start as the return address.
+  sp = (int*)((char*)t + STACK_SIZE);
+  *--sp = 0;                  // thread_start's return address
+  *--sp = (int)thread_start;
+  sp -= 4;                    // ebp, ebx, esi, edi
+  memset(sp, 0, 4*sizeof(int));
+  t->sp = (int)sp;
+
+  // Once thread_run() has started only threads get here,
+  // and they must not be switched out holding runq.lock.
+  self = 0;
+  if(started){
+    self = thread_self();
+    self->nopreempt = 1;
   }
+  lock(&runq.lock);
+  t->id = id = ++nextid;
+  runq.nthread++;
+  unlock(&runq.lock);
+  enqueue(t);   // t may run and exit at once
+  if(self)
+    self->nopreempt = 0;
+  return id;
+}
 
-  if (current_thread != next_thread) {         /* switch threads?  */
-    next_thread->state = RUNNING;
-    thread_switch();
-  } else
-    next_thread = 0;
+// Switch from t back to its worker's scheduler.
+// t->nopreempt must be set.
+static void
+sched(struct thread *t, int state)
+{
+  t->state = state;
+  thread_switch(&t->sp, t->w->sp);
 }
 
-/**
-Loop through all threads, stopping at the first
-FREE thread, setting up its stack for thread_switch,
-inserting the address of the `mythread` function as
-a fake "return address" for thread_switch to jump to,
-and marking it RUNNABLE.
-*/
 void
-thread_create(void (*func)())
+thread_yield(void)
 {
-  thread_p t;
+  struct thread *t;
 
-  for (t = all_thread; t < all_thread + MAX_THREAD; t++) {
-    if (t->state == FREE) break;
-  }
-  t->sp = (int) (t->stack + STACK_SIZE);   // set sp to the top of the stack
-  t->sp -= 4;                              // space for return address
-  * (int *) (t->sp) = (int)func;           // push return address on stack
-  t->sp -= 32;                             // 32 bits expected by `popal` in uthread_switch
-  t->state = RUNNABLE;
+  t = thread_self();
+  t->nopreempt = 1;
+  sched(t, RUNNABLE);
+  t->nopreempt = 0;
 }
 
 void
-thread_yield(void)
+thread_exit(void)
+{
+  struct thread *t;
+
+  t = thread_self();
+  t->nopreempt = 1;
+  sched(t, ZOMBIE);
+  printf(2, "thread_exit: zombie ran\n");
+  exit();
+}
+
+// Called by thread_alarm on a timer upcall to whatever
+// worker took it.  If a thread was interrupted and may be
+// preempted, yield on its behalf; thread_alarm then resumes
+// it exactly where it stopped, possibly on another worker.
+void
+thread_preempt(void)
 {
-  current_thread->state = RUNNABLE;
-  thread_schedule();
+  struct worker *w;
+  struct thread *t;
+  int pid;
+
+  pid = getpid();
+  for(w = workers; w < &workers[nworker]; w++)
+    if(w->pid == pid)
+      break;
+  if(w == &workers[nworker])
+    return;
+  if((t = w->current) == 0 || t->nopreempt)
+    return;
+  t->nopreempt = 1;
+  sched(t, RUNNABLE);
+  t->nopreempt = 0;
 }
 
+// Free a thread that has exited.  If it was the last one,
+// wake every idle worker so that they can all return.
 static void
-mythread(void)
+reap(struct thread *t)
 {
-  int i;
-  printf(1, "my thread running\n");
-  for (i = 0; i < 100; i++) {
-    printf(1, "my thread 0x%x\n", (int) current_thread);
-    thread_yield();
+  int n;
+
+  free(t->mem);
+
+  lock(&runq.lock);
+  n = --runq.nthread;
+  if(n == 0)
+    runq.seq++;
+  unlock(&runq.lock);
+  if(n == 0)
+    futexwake(&runq.seq, MAX_WORKER);
+}
+
+// Worker loop: run threads until none are left.
+static void
+schedule(struct worker *w)
+{
+  struct thread *t;
+  int seq;
+
+  if(quantum)
+    alarm(quantum, thread_alarm);
+  for(;;){
+    lock(&runq.lock);
+    if((t = runq.head) == 0){
+      if(runq.nthread == 0){
+        unlock(&runq.lock);
+        break;
+      }
+      runq.nidle++;
+      seq = runq.seq;
+      unlock(&runq.lock);
+      futexwait(&runq.seq, seq);
+      lock(&runq.lock);
+      runq.nidle--;
+      unlock(&runq.lock);
+      continue;
+    }
+    runq.head = t->next;
+    if(runq.head == 0)
+      runq.tail = 0;
+    unlock(&runq.lock);
+
+    t->state = RUNNING;
+    t->w = w;
+    w->current = t;
+    thread_switch(&w->sp, t->sp);
+    w->current = 0;
+
+    if(t->state == ZOMBIE)
+      reap(t);
+    else
+      enqueue(t);
   }
-  printf(1, "my thread: exit\n");
-  current_thread->state = FREE;
-  thread_schedule();
+  if(quantum)
+    alarm(0, 0);
 }
 
+static void
+workerstart(void *arg)
+{
+  schedule((struct worker*)arg);
+  exit();
+}
 
-int
-main(int argc, char *argv[])
+// Run threads on nworker workers until they have all
+// exited.  The calling process is the first worker.
+void
+thread_run(void)
 {
-  thread_init();
-  thread_create(mythread);
-  thread_create(mythread);
-  thread_schedule();
-  return 0;
+  struct worker *w;
+  void *stack;
+
+  started = 1;
+  workers[0].pid = getpid();
+  for(w = &workers[1]; w < &workers[nworker]; w++){
+    if((w->stack = malloc(4096)) == 0 ||
+       (w->pid = clone(workerstart, w, w->stack)) < 0){
+      printf(2, "thread_run: cannot start worker\n");
+      exit();
+    }
+  }
+  schedule(&workers[0]);
+  for(w = &workers[1]; w < &workers[nworker]; w++){
+    if(join(&stack) < 0)
+      break;
+    free(stack);
+  }
+  started = 0;
 }
@@ -0,0 +1,27 @@
+// User-level threads, multiplexed onto one or more clone()d
+// kernel threads ("workers").  See uthread.c.
+
+#define STACK_SIZE  8192   // per thread; a power of two
+#define MAX_WORKER  8
+
+struct worker;
+
+struct thread {
+  int sp;                  // saved stack pointer; must be first
+  int state;               // RUNNABLE, RUNNING or ZOMBIE
+  int id;
+  struct thread *next;     // run queue link
+  struct worker *w;        // worker running this thread
+  void (*fn)(void*);
+  void *arg;
+  void *tls;               // free for the thread's own use
+  volatile int nopreempt;  // don't switch out on alarm
+  char *mem;               // malloc()ed block holding thread and stack
+};
+
+void thread_init(int nworker, int quantum);
+int thread_create(void (*fn)(void*), void *arg);
+void thread_yield(void);
+void thread_exit(void) __attribute__((noreturn));
+void thread_run(void);
+struct thread *thread_self(void);
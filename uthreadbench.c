@@ -0,0 +1,63 @@
+// Measure the cost of a user-level thread switch: nthread
+// threads each call thread_yield() nyield times, spread over
+// nworker workers.
+//
+// usage: uthreadbench [nthread [nyield [nworker]]]
+
+#include "types.h"
+#include "stat.h"
+#include "user.h"
+#include "uthread.h"
+
+static int nyield = 100000;
+
+static void
+yielder(void *arg)
+{
+  int i;
+
+  for(i = 0; i < nyield; i++)
+    thread_yield();
+}
+
+int
+main(int argc, char *argv[])
+{
+  int i, nthread, nworker, t0, t;
+  uint nswitch;
+  unsigned long long ns;
+
+  nthread = 2;
+  nworker = 1;
+  if(argc > 1)
+    nthread = atoi(argv[1]);
+  if(argc > 2)
+    nyield = atoi(argv[2]);
+  if(argc > 3)
+    nworker = atoi(argv[3]);
+  if(nthread <= 0 || nyield <= 0 || nworker <= 0){
+    printf(2, "usage: uthreadbench [nthread [nyield [nworker]]]\n");
+    exit();
+  }
+
+  thread_init(nworker, 0);
+  for(i = 0; i < nthread; i++){
+    if(thread_create(yielder, 0) < 0){
+      printf(2, "uthreadbench: thread_create failed\n");
+      exit();
+    }
+  }
+  t0 = uptime();
+  thread_run();
+  t = uptime() - t0;
+
+  // Each yield is a switch to the scheduler and back.
+  // One tick is 10ms; t * 10^7 ns overflows 32 bits after
+  // 429 ticks, so divide it as 64 bits.
+  nswitch = (uint)nthread * nyield;
+  ns = (unsigned long long)(uint)t * 10000000;
+  printf(1, "%d threads, %d workers: %d yields in %d ticks, %d ns/yield\n",
+         nthread, nworker, nswitch, t,
+         nswitch ? div64(ns >> 32, ns, nswitch) : 0);
+  exit();
+}
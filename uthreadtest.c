@@ -0,0 +1,46 @@
+#include "types.h"
+#include "stat.h"
+#include "user.h"
+#include "uthread.h"
+
+// Set by spinner i once it runs.  Each spinner waits for the
+// other without yielding, so with one worker they can only
+// both finish if the alarm preempts them.
+static volatile int spun[2];
+
+static void
+mythread(void *arg)
+{
+  int i;
+
+  printf(1, "my thread running\n");
+  for (i = 0; i < 100; i++) {
+    printf(1, "my thread 0x%x\n", (int) thread_self());
+    thread_yield();
+  }
+  printf(1, "my thread: exit\n");
+}
+
+static void
+spinner(void *arg)
+{
+  int i = (int) arg;
+
+  spun[i] = 1;
+  while (!spun[!i])
+    ;
+  printf(1, "spinner %d: preempted ok\n", i);
+}
+
+int
+main(int argc, char *argv[])
+{
+  thread_init(1, 1);
+  thread_create(mythread, 0);
+  thread_create(mythread, 0);
+  thread_create(spinner, (void*) 0);
+  thread_create(spinner, (void*) 1);
+  thread_run();
+  printf(1, "uthreadtest: all threads done\n");
+  exit();
+}
@@ -0,0 +1,65 @@
+// Pages of kernel data mapped read-only into every process,
+// so that user code can read the time and its pid without a
+// system call.  The timer interrupt keeps struct vdso current;
+// readers retry while vdso->seq is odd or has changed.
+
+#include "types.h"
+#include "defs.h"
+#include "param.h"
+#include "memlayout.h"
+#include "mmu.h"
+#include "x86.h"
+#include "date.h"
+#include "vdso.h"
+
+struct vdso *vdso;
+
+void
+vdsoinit(void)
+{
+  if((vdso = (struct vdso*)kalloc_zeroed()) == 0)
+    panic("vdsoinit");
+  cmostime(&vdso->date);
+}
+
+// Called by the timer interrupt on cpu 0 after ticks changes.
+void
+vdsotick(uint ticks)
+{
+  unsigned long long tsc;
+  uint lo;
+
+  tsc = rdtsc();
+  lo = (uint)tsc;
+  vdso->seq++;
+  __sync_synchronize();
+  vdso->tscpertick = lo - vdso->tsclo;
+  vdso->tscperus = vdso->tscpertick / 10000;  // 10ms ticks
+  vdso->tsclo = lo;
+  vdso->tschi = (uint)(tsc >> 32);
+  vdso->ticks = ticks;
+  if(ticks % 100 == 0)
+    cmostime(&vdso->date);
+  __sync_synchronize();
+  vdso->seq++;
+}
+
+// Map the shared vdso page and a new vproc page for pid into
+// pgdir, both read-only.  freevm() frees the vproc page with
+// the rest; the vdso page is permanent and not reference counted.
+int
+vdsomap(pde_t *pgdir, int pid)
+{
+  char *mem;
+
+  if((mem = kalloc_zeroed()) == 0)
+    return -1;
+  ((struct vproc*)mem)->pid = pid;
+  if(mappages(pgdir, (char*)VPROC, PGSIZE, V2P(mem), PTE_U) < 0){
+    kfree(mem);
+    return -1;
+  }
+  if(mappages(pgdir, (char*)VDSO, PGSIZE, V2P(vdso), PTE_U) < 0)
+    return -1;
+  return 0;
+}
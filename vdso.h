@@ -0,0 +1,18 @@
+// Kernel-maintained pages that user code can read without a
+// system call (see vdso.c and ulib.c).  Include after date.h.
+
+// Read-only page shared by every process, at VDSO.
+struct vdso {
+  volatile uint seq;    // odd while the kernel is updating
+  uint ticks;           // as returned by uptime()
+  uint tsclo;           // time-stamp counter at the last tick
+  uint tschi;
+  uint tscpertick;      // TSC cycles in the last tick
+  uint tscperus;        // tscpertick / 10000
+  struct rtcdate date;  // wall clock, refreshed about once a second
+};
+
+// Read-only page private to each address space, at VPROC.
+struct vproc {
+  int pid;              // of the process that exec()ed or fork()ed it
+};
@@ -0,0 +1,217 @@
+// Virtio block device driver, legacy PCI transport.
+//
+// Requests go through a single virtqueue as three-descriptor
+// chains: header, data, status.  Many requests can be in the
+// queue at once, from different processes or from one caller
+// of virtiorw() passing a batch, and the device is notified
+// once per batch rather than once per request.
+
+#include "types.h"
+#include "defs.h"
+#include "param.h"
+#include "memlayout.h"
+#include "mmu.h"
+#include "proc.h"
+#include "x86.h"
+#include "spinlock.h"
+#include "sleeplock.h"
+#include "fs.h"
+#include "buf.h"
+#include "pci.h"
+#include "virtio.h"
+
+#define VQMAX 256  // largest queue we can handle
+
+static struct {
+  struct spinlock lock;
+  ushort iobase;   // 0 if there is no device
+  int irq;
+  int qsize;
+  struct vring_desc *desc;
+  struct vring_avail *avail;
+  struct vring_used *used;
+  ushort lastused;  // next used ring entry to look at
+  int pending;      // chains added to avail but not yet published
+  int nfree;
+  char isfree[VQMAX];
+  // Per-request state, indexed by the chain's first descriptor.
+  struct {
+    struct buf *b;
+    uchar status;
+    struct virtio_blk_req hdr;
+  } info[VQMAX];
+} vdisk;
+
+// The queue must be physically contiguous and page aligned.
+static char vqmem[VRING_SIZE(VQMAX)] __attribute__((aligned(PGSIZE)));
+
+// Find and set up a virtio block device.
+// Return 0 on success, -1 if there is none.
+int
+virtioinit(void)
+{
+  struct pcidev d;
+  int i;
+
+  if(pcifind(&d, VIRTIO_VENDOR, VIRTIO_DEV_BLK, PCI_ANY, PCI_ANY) < 0)
+    return -1;
+  if(!(d.bar[0] & 1))
+    return -1;
+  initlock(&vdisk.lock, "virtio");
+  pciwrite(&d, PCI_COMMAND,
+           pciread(&d, PCI_COMMAND) | PCI_CMD_IO | PCI_CMD_MASTER);
+  vdisk.iobase = d.bar[0] & ~3;
+
+  // Reset, then say we have noticed it and can drive it.
+  outb(vdisk.iobase+VIRTIO_STATUS, 0);
+  outb(vdisk.iobase+VIRTIO_STATUS, VIRTIO_ST_ACK);
+  outb(vdisk.iobase+VIRTIO_STATUS, VIRTIO_ST_ACK|VIRTIO_ST_DRIVER);
+  outl(vdisk.iobase+VIRTIO_GUESTFEAT, 0);
+
+  outw(vdisk.iobase+VIRTIO_QSEL, 0);
+  vdisk.qsize = inw(vdisk.iobase+VIRTIO_QSIZE);
+  if(vdisk.qsize == 0 || vdisk.qsize > VQMAX){
+    outb(vdisk.iobase+VIRTIO_STATUS, VIRTIO_ST_FAILED);
+    vdisk.iobase = 0;
+    return -1;
+  }
+  memset(vqmem, 0, sizeof(vqmem));
+  vdisk.desc = (struct vring_desc*)vqmem;
+  vdisk.avail = (struct vring_avail*)(vqmem + sizeof(struct vring_desc)*vdisk.qsize);
+  vdisk.used = (struct vring_used*)(vqmem + VRING_USEDOFF(vdisk.qsize));
+  outl(vdisk.iobase+VIRTIO_QPFN, V2P(vqmem) >> PGSHIFT);
+  for(i = 0; i < vdisk.qsize; i++)
+    vdisk.isfree[i] = 1;
+  vdisk.nfree = vdisk.qsize;
+
+  vdisk.irq = d.irq;
+  picenable(vdisk.irq);
+  ioapicenable(vdisk.irq, ncpu - 1);
+  outb(vdisk.iobase+VIRTIO_STATUS,
+       VIRTIO_ST_ACK|VIRTIO_ST_DRIVER|VIRTIO_ST_OK);
+  return 0;
+}
+
+// Take a free descriptor.  Caller has checked nfree.
+static int
+allocdesc(void)
+{
+  int i;
+
+  for(i = 0; i < vdisk.qsize; i++){
+    if(vdisk.isfree[i]){
+      vdisk.isfree[i] = 0;
+      vdisk.nfree--;
+      return i;
+    }
+  }
+  panic("virtio: no free desc");
+}
+
+static void
+freechain(int i)
+{
+  for(;;){
+    vdisk.isfree[i] = 1;
+    vdisk.nfree++;
+    if(!(vdisk.desc[i].flags & VRING_DESC_NEXT))
+      break;
+    i = vdisk.desc[i].next;
+  }
+}
+
+static void
+setdesc(int i, void *addr, uint len, ushort flags, ushort next)
+{
+  vdisk.desc[i].addr = V2P(addr);
+  vdisk.desc[i].addrhi = 0;
+  vdisk.desc[i].len = len;
+  vdisk.desc[i].flags = flags;
+  vdisk.desc[i].next = next;
+}
+
+// Publish the chains added since the last kick and,
+// unless the device has said it will poll, notify it.
+static void
+kick(void)
+{
+  if(vdisk.pending == 0)
+    return;
+  __sync_synchronize();
+  vdisk.avail->idx += vdisk.pending;
+  vdisk.pending = 0;
+  __sync_synchronize();
+  if(!(vdisk.used->flags & VRING_USED_NO_NOTIFY))
+    outw(vdisk.iobase+VIRTIO_QNOTIFY, 0);
+}
+
+// Read or write each of the n locked buffers in bs, as iderw
+// does, queueing them all before waiting for any.
+void
+virtiorw(struct buf **bs, int n)
+{
+  struct buf *b;
+  int i, d0, d1, d2, write;
+
+  acquire(&vdisk.lock);
+  for(i = 0; i < n; i++){
+    b = bs[i];
+    if(b->blockno >= FSSIZE)
+      panic("virtiorw: blockno");
+    while(vdisk.nfree < 3){
+      kick();
+      sleep(&vdisk.nfree, &vdisk.lock);
+    }
+    d0 = allocdesc();
+    d1 = allocdesc();
+    d2 = allocdesc();
+    write = (b->flags & B_DIRTY) != 0;
+    vdisk.info[d0].b = b;
+    vdisk.info[d0].status = 0xff;
+    vdisk.info[d0].hdr.type = write ? VIRTIO_BLK_T_OUT : VIRTIO_BLK_T_IN;
+    vdisk.info[d0].hdr.reserved = 0;
+    vdisk.info[d0].hdr.sector = b->blockno * (BSIZE/512);
+    vdisk.info[d0].hdr.sectorhi = 0;
+    setdesc(d0, &vdisk.info[d0].hdr, sizeof(vdisk.info[d0].hdr),
+            VRING_DESC_NEXT, d1);
+    setdesc(d1, b->data, BSIZE,
+            VRING_DESC_NEXT | (write ? 0 : VRING_DESC_WRITE), d2);
+    setdesc(d2, &vdisk.info[d0].status, 1, VRING_DESC_WRITE, 0);
+    vdisk.avail->ring[(ushort)(vdisk.avail->idx + vdisk.pending) % vdisk.qsize] = d0;
+    vdisk.pending++;
+  }
+  kick();
+
+  for(i = 0; i < n; i++)
+    while((bs[i]->flags & (B_VALID|B_DIRTY)) != B_VALID)
+      sleep(bs[i], &vdisk.lock);
+  release(&vdisk.lock);
+}
+
+// Interrupt handler.  Return 1 if irq was the disk's.
+int
+virtiointr(int irq)
+{
+  struct buf *b;
+  int id;
+
+  if(vdisk.iobase == 0 || irq != vdisk.irq)
+    return 0;
+  acquire(&vdisk.lock);
+  inb(vdisk.iobase+VIRTIO_ISR);  // acknowledge
+  while(vdisk.lastused != vdisk.used->idx){
+    __sync_synchronize();
+    id = vdisk.used->ring[vdisk.lastused % vdisk.qsize].id;
+    if(vdisk.info[id].status != VIRTIO_BLK_S_OK)
+      panic("virtiointr: disk error");
+    b = vdisk.info[id].b;
+    b->flags |= B_VALID;
+    b->flags &= ~B_DIRTY;
+    wakeup(b);
+    freechain(id);
+    vdisk.lastused++;
+  }
+  wakeup(&vdisk.nfree);
+  release(&vdisk.lock);
+  return 1;
+}
@@ -0,0 +1,70 @@
+// Virtio over the legacy PCI transport (virtio spec 0.9.5).
+
+// I/O port registers, at BAR0.
+#define VIRTIO_HOSTFEAT   0x00  // features the device offers (32 bits)
+#define VIRTIO_GUESTFEAT  0x04  // features the driver accepts (32 bits)
+#define VIRTIO_QPFN       0x08  // page number of the selected queue (32)
+#define VIRTIO_QSIZE      0x0c  // size of the selected queue (16)
+#define VIRTIO_QSEL       0x0e  // select a queue (16)
+#define VIRTIO_QNOTIFY    0x10  // tell the device a queue has work (16)
+#define VIRTIO_STATUS     0x12  // device status (8)
+#define VIRTIO_ISR        0x13  // interrupt status; reading clears (8)
+#define VIRTIO_CONFIG     0x14  // device-specific configuration
+
+// Device status bits.
+#define VIRTIO_ST_ACK      1
+#define VIRTIO_ST_DRIVER   2
+#define VIRTIO_ST_OK       4
+#define VIRTIO_ST_FAILED   128
+
+#define VIRTIO_VENDOR    0x1af4
+#define VIRTIO_DEV_BLK   0x1001  // legacy block device
+
+// Virtqueue layout.  The driver owns the descriptor table and the
+// available ring; the device owns the used ring, which starts on
+// the next page boundary.
+struct vring_desc {
+  uint addr;       // physical address, low 32 bits
+  uint addrhi;     // high 32 bits, always 0
+  uint len;
+  ushort flags;
+  ushort next;     // next descriptor if VRING_DESC_NEXT
+};
+#define VRING_DESC_NEXT   1  // chained with next
+#define VRING_DESC_WRITE  2  // device writes (vs reads)
+
+struct vring_avail {
+  ushort flags;
+  ushort idx;      // where the driver puts the next entry
+  ushort ring[];   // descriptor chain heads
+};
+
+struct vring_used_elem {
+  uint id;         // head of the completed descriptor chain
+  uint len;
+};
+
+struct vring_used {
+  ushort flags;
+  ushort idx;      // where the device puts the next entry
+  struct vring_used_elem ring[];
+};
+#define VRING_USED_NO_NOTIFY  1  // device does not need notifying
+
+// Bytes of memory for a queue of n entries.
+#define VRING_USEDOFF(n) \
+  PGROUNDUP(sizeof(struct vring_desc)*(n) + sizeof(ushort)*(3+(n)))
+#define VRING_SIZE(n) \
+  (VRING_USEDOFF(n) + sizeof(ushort)*3 + sizeof(struct vring_used_elem)*(n))
+
+// Block request header, followed by the data and a status byte.
+struct virtio_blk_req {
+  uint type;
+  uint reserved;
+  uint sector;     // low 32 bits
+  uint sectorhi;
+};
+#define VIRTIO_BLK_T_IN   0  // read
+#define VIRTIO_BLK_T_OUT  1  // write
+
+#define VIRTIO_BLK_S_OK   0
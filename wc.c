@@ -1,54 +1,87 @@
 #include "types.h"
 #include "stat.h"
 #include "user.h"
+#include "fcntl.h"
+#include "ring.h"
 
-char buf[512];
+// Reads of a named file are batched NREAD at a time with
+// ring_enter(), and opening it goes in the first batch.
+// Standard input may be the console, where a read waits for
+// a line, so it is read one buffer at a time.
+#define NREAD 8
+#define OPENED 0xffffffff
 
+char buf[NREAD][512];
+struct ring ring;
+
+// Count fd, or if fd is -1 the file called name.
 void
 wc(int fd, char *name)
 {
-  int i, n;
-  int l, w, c, inword;
+  struct cqe c;
+  int i, b, n, nread, eof, link, opened;
+  int l, w, cc, inword;
 
-  l = w = c = 0;
+  l = w = cc = 0;
   inword = 0;
-  while((n = read(fd, buf, sizeof(buf))) > 0){
-    for(i=0; i<n; i++){
-      c++;
-      if(buf[i] == '\n')
-        l++;
-      if(strchr(" \r\t\n\v", buf[i]))
-        inword = 0;
-      else if(!inword){
-        w++;
-        inword = 1;
+  link = 0;
+  opened = fd < 0;
+  if(opened){
+    ringput(&ring, RING_OPEN, 0, 0, name, O_RDONLY, OPENED);
+    link = RING_LINK;
+  }
+  nread = opened ? NREAD : 1;
+  eof = 0;
+  while(!eof){
+    for(b = 0; b < nread; b++)
+      ringput(&ring, RING_READ, link, fd, buf[b], sizeof(buf[b]), b);
+    ring_enter(&ring);
+    link = 0;
+    while(ringget(&ring, &c)){
+      if(c.data == OPENED){
+        if((fd = c.res) < 0){
+          printf(1, "wc: cannot open %s\n", name);
+          exit();
+        }
+        continue;
+      }
+      if(eof)
+        continue;
+      if((n = c.res) < 0){
+        printf(1, "wc: read error\n");
+        exit();
+      }
+      if(n == 0)
+        eof = 1;
+      for(i=0; i<n; i++){
+        cc++;
+        if(buf[c.data][i] == '\n')
+          l++;
+        if(strchr(" \r\t\n\v", buf[c.data][i]))
+          inword = 0;
+        else if(!inword){
+          w++;
+          inword = 1;
+        }
       }
     }
   }
-  if(n < 0){
-    printf(1, "wc: read error\n");
-    exit();
-  }
-  printf(1, "%d %d %d %s\n", l, w, c, name);
+  if(opened)
+    close(fd);
+  printf(1, "%d %d %d %s\n", l, w, cc, name);
 }
 
 int
 main(int argc, char *argv[])
 {
-  int fd, i;
+  int i;
 
   if(argc <= 1){
     wc(0, "");
     exit();
   }
 
-  for(i = 1; i < argc; i++){
-    if((fd = open(argv[i], 0)) < 0){
-      printf(1, "wc: cannot open %s\n", argv[i]);
-      exit();
-    }
-    wc(fd, argv[i]);
-    close(fd);
-  }
+  for(i = 1; i < argc; i++)
+    wc(-1, argv[i]);
   exit();
 }
@@ -30,6 +30,30 @@ outw(ushort port, ushort data)
   asm volatile("out %0,%1" : : "a" (data), "d" (port));
 }
 
+static inline ushort
+inw(ushort port)
+{
+  ushort data;
+
+  asm volatile("in %1,%0" : "=a" (data) : "d" (port));
+  return data;
+}
+
+static inline uint
+inl(ushort port)
+{
+  uint data;
+
+  asm volatile("in %1,%0" : "=a" (data) : "d" (port));
+  return data;
+}
+
+static inline void
+outl(ushort port, uint data)
+{
+  asm volatile("out %0,%1" : : "a" (data), "d" (port));
+}
+
 static inline void
 outsl(int port, const void *addr, int cnt)
 {
@@ -57,6 +81,24 @@ stosl(void *addr, int data, int cnt)
                "memory", "cc");
 }
 
+static inline void
+movsb(void *dst, const void *src, int cnt)
+{
+  asm volatile("cld; rep movsb" :
+               "=D" (dst), "=S" (src), "=c" (cnt) :
+               "0" (dst), "1" (src), "2" (cnt) :
+               "memory", "cc");
+}
+
+static inline void
+movsl(void *dst, const void *src, int cnt)
+{
+  asm volatile("cld; rep movsl" :
+               "=D" (dst), "=S" (src), "=c" (cnt) :
+               "0" (dst), "1" (src), "2" (cnt) :
+               "memory", "cc");
+}
+
 struct segdesc;
 
 static inline void
@@ -117,6 +159,13 @@ sti(void)
   asm volatile("sti");
 }
 
+// Tell the CPU this is a spin-wait loop.
+static inline void
+pause(void)
+{
+  asm volatile("pause");
+}
+
 static inline uint
 xchg(volatile uint *addr, uint newval)
 {
@@ -147,6 +196,21 @@ lcr3(uint val)
   asm volatile("movl %0,%%cr3" : : "r" (val));
 }
 
+static inline void
+wrmsr(uint msr, uint val)
+{
+  asm volatile("wrmsr" : : "c" (msr), "a" (val), "d" (0));
+}
+
+// Read the time-stamp counter; usable from user space too.
+static inline unsigned long long
+rdtsc(void)
+{
+  unsigned long long val;
+  asm volatile("rdtsc" : "=A" (val));
+  return val;
+}
+
 //PAGEBREAK: 36
 // Layout of the trap frame built on the stack by the
 // hardware and by trapasm.S, and passed to trap().